@@ -3,20 +3,19 @@
 #include <TimerOne.h>
 #include <SPI.h>
 
-#define LOOP_TENTHS     5 // defines loop period in 0.1s
-
 StratoRATS strato;
 
 // timer control variables
 volatile uint8_t timer_counter = 0;
 uint8_t heartbeat_led = 0;
-volatile bool loop_flag = false;
 
- // Serial Buffers for T4.1
-uint8_t Zephyr_serial_TX_buffer[ZEPHYR_SERIAL_BUFFER_SIZE];
-uint8_t Zephyr_serial_RX_buffer[ZEPHYR_SERIAL_BUFFER_SIZE];
-uint8_t mcb_serial_TX_buffer[MCB_SERIAL_BUFFER_SIZE];
-uint8_t mcb_serial_RX_buffer[MCB_SERIAL_BUFFER_SIZE];
+ // Serial Buffers for T4.1, in RAM2 (see MemoryBudget.cpp)
+#ifndef LOG_ZEPHYR_COMMS_SHARED
+DMAMEM uint8_t Zephyr_serial_TX_buffer[ZEPHYR_SERIAL_BUFFER_SIZE];
+DMAMEM uint8_t Zephyr_serial_RX_buffer[ZEPHYR_SERIAL_BUFFER_SIZE];
+#endif
+DMAMEM uint8_t mcb_serial_TX_buffer[MCB_SERIAL_BUFFER_SIZE];
+DMAMEM uint8_t mcb_serial_RX_buffer[MCB_SERIAL_BUFFER_SIZE];
 
 // ISR for Zephyr port (on LPC)
 // void serialEvent2()
@@ -30,20 +29,61 @@ uint8_t mcb_serial_RX_buffer[MCB_SERIAL_BUFFER_SIZE];
 //   }
 // }
 
+// Serial event handlers, called from yield() when RX data is available
+#ifndef LOG_ZEPHYR_COMMS_SHARED
+void serialEvent1() {
+  strato.PostEvent(EVENT_ZEPHYR_RX);
+}
+#else
+void serialEvent() {
+  strato.PostEvent(EVENT_ZEPHYR_RX);
+}
+#endif
+
+void serialEvent3() {
+  strato.PostEvent(EVENT_MCB_RX);
+}
+
+// ISR for the LoRa DIO (RX done) line
+void LoRaInterrupt(void) {
+  strato.LoRaISR();
+}
+
 // ISR for timer
 void ControlLoopTimer(void) {
   if (++timer_counter == LOOP_TENTHS) {
     timer_counter = 0;
-    loop_flag = true;
+    strato.PostEvent(EVENT_TICK);
+  }
+  // The heartbeat LED stays off in low power mode
+  if (strato.Sleeping()) {
+    digitalWrite(HEARTBEAT_LED_PIN, LOW);
+  } else {
+    digitalWrite(HEARTBEAT_LED_PIN, ((heartbeat_led++/20 & 1) ? LOW : HIGH));
   }
-  digitalWrite(HEARTBEAT_LED_PIN, ((heartbeat_led++/20 & 1) ? LOW : HIGH));
 }
 
-// Loop timing function
-void WaitForControlTimer(void) {
-  while (!loop_flag) delay(1);
+// Wait for any event. yield() dispatches the serialEvent handlers.
+// Deferred log records are drained while waiting.
+// In low power mode the core sleeps until the next interrupt when idle.
+uint8_t WaitForEvents(void) {
+  uint8_t events = strato.TakeEvents();
+  while (!events) {
+    strato.DrainLog();
+    yield();
+    events = strato.TakeEvents();
+    if (!events) {
+      strato.LowPowerIdle();
+    }
+  }
 
-  loop_flag = false;
+  strato.LowPowerWake(events);
+  return events;
+}
+
+// Loop timing function, only used during setup
+void WaitForControlTimer(void) {
+  while (!(WaitForEvents() & EVENT_TICK));
 }
 
 // Standard Arduino setup function
@@ -73,8 +113,8 @@ void setup()
 #endif
 
     // MCB serial will always be on digital I/O pins
-    MCB_SERIAL.addMemoryForRead(&Zephyr_serial_RX_buffer, sizeof(Zephyr_serial_RX_buffer));
-    MCB_SERIAL.addMemoryForWrite(&Zephyr_serial_TX_buffer, sizeof(Zephyr_serial_TX_buffer));
+    MCB_SERIAL.addMemoryForRead(&mcb_serial_RX_buffer, sizeof(mcb_serial_RX_buffer));
+    MCB_SERIAL.addMemoryForWrite(&mcb_serial_TX_buffer, sizeof(mcb_serial_TX_buffer));
 
   // Timer interrupt setup for main loop timing
   Timer1.initialize(100000); // 0.1 s
@@ -86,20 +126,53 @@ void setup()
 
   strato.InitializeCore();
   strato.InstrumentSetup();
+
+  // The LoRa DIO line goes high when a packet has been received.
+  // LoRaISR() only posts EVENT_LORA_RX; the radio is read in the main loop.
+  strato.LoRaAttachISR(LoRaInterrupt);
+
+#ifdef RATS_BENCH
+  strato.Bench();
+#endif
 }
 
+// Time a loop stage
+#define PROFILE(stage, call) do { profiler.Start(); call; profiler.Stop(stage); } while (0)
+
 // Standard Arduino loop function
 void loop()
 {
-  // StratoCore loop functions
-  strato.KickWatchdog();
-  strato.RunScheduler();
-  strato.RunRouter();
-  strato.RunMCBRouter();
-  strato.RunMode();
-  strato.InstrumentLoop();
-
-  // Wait for loop timer
-  WaitForControlTimer();
-}
+  LoopProfiler& profiler = strato.Profiler();
 
+  uint8_t events = WaitForEvents();
+  uint32_t tick_start = ARM_DWT_CYCCNT;
+  uint32_t allocs = HeapAllocCount();
+
+  if (events & EVENT_TICK) {
+    PROFILE(STAGE_WATCHDOG, strato.KickWatchdog());
+    PROFILE(STAGE_SCHEDULER, strato.RunScheduler());
+  }
+  // Due actions are set on every pass, so the routers see them without waiting for a tick
+  strato.RunRATSScheduler();
+
+  // The I/O routers run as soon as data arrives
+  if (events & (EVENT_TICK | EVENT_ZEPHYR_RX)) {
+    PROFILE(STAGE_ZEPHYR_ROUTER, strato.RunZephyrRouter());
+  }
+  if (events & (EVENT_TICK | EVENT_MCB_RX)) {
+    PROFILE(STAGE_MCB_ROUTER, strato.RunMCBRouter());
+  }
+  if ((events & EVENT_LORA_RX) && !(events & EVENT_TICK)) {
+    PROFILE(STAGE_LORA, strato.LoRaRX()); // InstrumentLoop() will check LoRa on the tick
+  }
+
+  // The mode state machines run on the LOOP_TENTHS cadence
+  if (events & EVENT_TICK) {
+    PROFILE(STAGE_MODE, strato.RunMode());
+    PROFILE(STAGE_INSTRUMENT, strato.InstrumentLoop());
+    profiler.Add(STAGE_TICK, ARM_DWT_CYCCNT - tick_start);
+  }
+
+  // Steady state should not touch the heap
+  profiler.AddAllocs(HeapAllocCount() - allocs);
+}
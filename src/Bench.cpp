@@ -0,0 +1,151 @@
+/*
+ *  Bench.cpp
+ *
+ *  Handler benchmarks for the env:rats_bench build (-DRATS_BENCH). They run
+ *  once at startup on a bench Teensy with no MCB, ECU or Zephyr attached:
+ *  synthetic ECU LoRa frames, MCB motion records and TCs are fed through the
+ *  same code paths used in flight, with the Zephyr output discarded. Results
+ *  are printed to the debug port.
+ *
+ *  The benchmarks leave nothing behind: the report format is selected with
+ *  bench_format rather than the EEPROM config, nothing is written to the SD
+ *  data log while bench_active is set, and BenchCleanup() clears the stats and
+ *  link state that the synthetic traffic went through.
+ */
+
+#ifdef RATS_BENCH
+
+#include "StratoRATS.h"
+
+// Number of iterations for each benchmark
+#define BENCH_LORA_FRAMES   2000
+#define BENCH_MCB_RECORDS   2000
+#define BENCH_TCS           200
+
+// Print one benchmark result
+static void BenchReport(const char* name, uint32_t n, uint32_t elapsed_us, LatencyStats_t& latency, uint32_t allocs)
+{
+    snprintf(log_array, LOG_ARRAY_SIZE, "BENCH %s: %lu in %lu us (%lu/s), worst %lu us, mean %lu us, %lu allocs",
+        name, n, elapsed_us, elapsed_us ? (uint32_t)(1000000ULL * n / elapsed_us) : 0,
+        latency.max_us, latency.Mean(), allocs);
+    log_nominal(log_array);
+}
+
+void StratoRATS::Bench()
+{
+    LatencyStats_t latency;
+    uint32_t start, t, allocs;
+
+    log_nominal("BENCH starting, Zephyr output is discarded");
+    zephyr_tx.SetSink(true);
+    bench_active = true;
+
+    // ECU LoRa frames through the LoRa RX queue into the RATS report, for each report format
+    uint32_t tms = 0;
+    for (uint8_t format = REPORT_FORMAT_RAW; format <= REPORT_FORMAT_CHANGED_BYTES; format++) {
+        bench_format = format;
+        for (uint i = 0; i < RATS_REPORT_SLOTS; i++) {
+            ratsReportReset(rats_reports[i]);
+        }
+        latency = LatencyStats_t();
+        allocs = HeapAllocCount();
+        start = micros();
+        for (uint32_t i = 0; i < BENCH_LORA_FRAMES; i++) {
+            LoRaFrame_t frame = {};
+            frame.msg.count = total_lora_count + 1;
+            frame.msg.data_len = ECU_REPORT_SIZE_BYTES;
+            // Slowly varying data, like real ECU records
+            for (uint j = 0; j < ECU_REPORT_SIZE_BYTES; j++) {
+                frame.msg.data[j] = (j < 4) ? (uint8_t)(i >> (8*j)) : (uint8_t)(j + (i >> 6));
+            }
+            t = micros();
+            lora_rx_queue.push(frame);
+            LoRaRX();
+            if (ratsReportOldestSealed()) {
+                ratsReportTM();
+                tms++;
+            }
+            latency.Add(micros() - t);
+        }
+        BenchReport(format == REPORT_FORMAT_RAW ? "LoRa->report raw" : "LoRa->report changed bytes",
+            BENCH_LORA_FRAMES, micros() - start, latency, HeapAllocCount() - allocs);
+        snprintf(log_array, LOG_ARRAY_SIZE, "BENCH   %lu report TMs", tms);
+        log_nominal(log_array);
+        tms = 0;
+    }
+    // MCB motion records through HandleMCBBin(), in the configured MCB TM mode
+    mcb_motion = MOTION_REEL_OUT;
+    InitMCBMotionTracking();
+    // The synthetic records are not a real motion
+    motion_health.enabled = false;
+    latency = LatencyStats_t();
+    allocs = HeapAllocCount();
+    start = micros();
+    for (uint32_t i = 0; i < BENCH_MCB_RECORDS; i++) {
+        mcbComm.binary_rx.bin_id = MCB_MOTION_TM;
+        mcbComm.binary_rx.bin_length = MOTION_TM_SIZE;
+        for (uint j = 0; j < MOTION_TM_SIZE; j++) {
+            mcbComm.binary_rx.bin_buffer[j] = (uint8_t)(i + j);
+        }
+        t = micros();
+        HandleMCBBin();
+        latency.Add(micros() - t);
+    }
+    mcb_motion_ongoing = false;
+    SendMCBTM(FINE, "BENCH motion finished");
+    BenchReport("MCB motion records", BENCH_MCB_RECORDS, micros() - start, latency, HeapAllocCount() - allocs);
+    snprintf(log_array, LOG_ARRAY_SIZE, "BENCH   %u MCB TM chunks", mcb_tm_chunk);
+    log_nominal(log_array);
+    mcb_motion = NO_MOTION;
+
+    // TC handling, with a TC that has no side effects
+    latency = LatencyStats_t();
+    allocs = HeapAllocCount();
+    start = micros();
+    for (uint32_t i = 0; i < BENCH_TCS; i++) {
+        t = micros();
+        TCHandler(RATSLORATXTESTOFF);
+        latency.Add(micros() - t);
+    }
+    tc_received = false;
+    BenchReport("TCs", BENCH_TCS, micros() - start, latency, HeapAllocCount() - allocs);
+
+    snprintf(log_array, LOG_ARRAY_SIZE, "BENCH done, %lu Zephyr bytes discarded", zephyr_tx.discarded);
+    log_nominal(log_array);
+    BenchCleanup();
+    zephyr_tx.SetSink(false);
+}
+
+void StratoRATS::BenchCleanup()
+{
+    bench_active = false;
+
+    // Empty report slots in the configured format
+    for (uint i = 0; i < RATS_REPORT_SLOTS; i++) {
+        ratsReportReset(rats_reports[i]);
+    }
+    rats_fill_slot = 0;
+    rats_tm_ack_pending = false;
+    rats_tm_seq = DATALOG_NO_SEQ;
+    mcb_tm_seq = DATALOG_NO_SEQ;
+
+    // LoRa counters and link stats, so the first ECU frame is not seen as a loss
+    total_lora_count = 0;
+    lora_radio_losses = 0;
+    lora_rx_overflows = 0;
+    lora_rx_overflows_counted = 0;
+    LoRaLinkReset();
+
+    // Latency and loop stats start from the first real pass through the loop
+    tc_ack_latency = LatencyStats_t();
+    mcb_ack_latency = LatencyStats_t();
+    rats_tm_ack_latency = LatencyStats_t();
+    for (uint i = 0; i < NUM_RATS_EVENTS; i++) {
+        wake_latency[i] = LatencyStats_t();
+    }
+    rats_report_drops = 0;
+    rats_tm_naks = 0;
+    loop_profiler.Reset();
+}
+
+#endif /* RATS_BENCH */
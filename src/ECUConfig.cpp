@@ -0,0 +1,100 @@
+/*
+ *  ECUConfig.cpp
+ *
+ *  The ECU only accepts one LoRa downlink per uplink, so parameter changes
+ *  are queued and merged into a single config message. A message carries
+ *  every queued parameter and every one that has not gone out yet, so a newer
+ *  message can replace one that is still waiting for its uplink.
+ *
+ *  The ECU does not echo or acknowledge a config message. A message is only
+ *  known to have been sent, once an uplink after the one that carried it comes
+ *  in; whether the ECU applied it can only be seen in its reports.
+ */
+
+#include "StratoRATS.h"
+#include "Serialize.h"
+
+// JSON keys, indexed by ECUConfigParam_t
+static const char* const ecu_config_keys[NUM_ECU_CONFIG_PARAMS] = {
+    "tempC",
+    "sf",
+    "bw",
+    "txp"
+};
+
+static_assert(NUM_ECU_CONFIG_PARAMS <= 8, "ECU config masks are 8 bits");
+
+void StratoRATS::ECUConfigSet(ECUConfigParam_t param, float value)
+{
+    if (param >= NUM_ECU_CONFIG_PARAMS) {
+        log_error("Unknown ECU config parameter");
+        return;
+    }
+
+    ecu_config_values[param] = value;
+    ecu_config_pending |= (1 << param);
+}
+
+bool StratoRATS::ECUConfigSend()
+{
+    static uint8_t msg[ECU_LORA_DATA_BUFSIZE];
+    uint8_t mask = ecu_config_pending | ecu_config_sent;
+    uint16_t len = 0;
+
+    if (!mask) {
+        return false;
+    }
+
+#if ECU_CONFIG_BINARY
+    uint16_t idx = 0;
+    msg[idx++] = ECU_CONFIG_BINARY_ID;
+    msg[idx++] = mask;
+    for (uint8_t i = 0; i < NUM_ECU_CONFIG_PARAMS; i++) {
+        if (mask & (1 << i)) {
+            BufferAddFloat(ecu_config_values[i], msg, sizeof(msg), &idx);
+        }
+    }
+    len = idx;
+    snprintf(log_array, LOG_ARRAY_SIZE, "ECU command: binary, mask 0x%02x, %u bytes", mask, len);
+#else
+    char* json = (char*)msg;
+    len = snprintf(json, sizeof(msg), "{");
+    for (uint8_t i = 0; i < NUM_ECU_CONFIG_PARAMS && len < sizeof(msg); i++) {
+        if (mask & (1 << i)) {
+            len += snprintf(json + len, sizeof(msg) - len, "%s\"%s\":%g",
+                (len > 1) ? "," : "", ecu_config_keys[i], ecu_config_values[i]);
+        }
+    }
+    if (len + 1 >= sizeof(msg)) {
+        log_error("ECU command too long");
+        return false;
+    }
+    len += snprintf(json + len, sizeof(msg) - len, "}");
+    snprintf(log_array, LOG_ARRAY_SIZE, "ECU command: %s", json);
+#endif
+    log_nominal(log_array);
+
+    // Don't forget that the message will not be sent until we receive a message from the ECU.
+    // A second call before then replaces this message, which is why it carries all unsent parameters.
+    // Also keep in mind that the ECU might not even be powered up right now.
+    ecu_lora_tx(msg, len);
+
+    ecu_config_sent = mask;
+    ecu_config_pending = 0;
+    ecu_config_sent_count = total_lora_count;
+    return true;
+}
+
+void StratoRATS::ECUConfigCheck()
+{
+    if (!ecu_config_sent) {
+        return;
+    }
+
+    if (total_lora_count - ecu_config_sent_count >= ECU_CONFIG_SENT_MSGS) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "ECU config sent, mask 0x%02x", ecu_config_sent);
+        log_nominal(log_array);
+        ZephyrLogFine(log_array);
+        ecu_config_sent = 0;
+    }
+}
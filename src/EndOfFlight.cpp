@@ -18,13 +18,13 @@ void StratoRATS::EndOfFlightMode()
     case EF_ENTRY:
         // perform setup
         // Register ACTION_RATS_REPORT to trigger the first status message 
-        scheduler.AddAction(ACTION_RATS_REPORT, 1);
+        ScheduleAction(ACTION_RATS_REPORT, 1000);
         inst_substate = EF_LOOP;
         log_nominal("Entering EF_LOOP");
         break;
     case EF_LOOP:
         // nominal ops
-        log_debug("EF loop");
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_EF_LOOP);
         break;
     case EF_SHUTDOWN:
         // prep for shutdown
@@ -15,10 +15,10 @@ void StratoRATS::FlightMode()
     // Save the flight mode substate to the global variable 
     flight_mode_substate = inst_substate;
 
-#if EXTRA_LOGGING
+#if RATS_LOG_LEVEL_MODE >= RLOG_DEBUG
     static uint old_inst_substate = 256;
     if (inst_substate != old_inst_substate) {
-        log_nominal((String("inst_substate:" + String(inst_substate)).c_str()));
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_FL_SUBSTATE, inst_substate);
         old_inst_substate = inst_substate;
     }
 #endif
@@ -27,7 +27,7 @@ void StratoRATS::FlightMode()
     case FL_ENTRY:
         log_nominal("Entering FL");
         // Transition to waiting for a GPS message.
-        scheduler.AddAction(ACTION_GPS_WAIT_MSG, 5);
+        ScheduleAction(ACTION_GPS_WAIT_MSG, 5000);
         inst_substate = FL_GPS_WAIT;
         log_nominal("Entering FL_GPS_WAIT");
         break;
@@ -35,7 +35,7 @@ void StratoRATS::FlightMode()
         // wait for a Zephyr GPS message to set the time before moving on
         if (CheckAction(ACTION_GPS_WAIT_MSG)) {
             log_nominal("FL_GPS_WAIT waiting for GPS Time");
-            scheduler.AddAction(ACTION_GPS_WAIT_MSG, 5);
+            ScheduleAction(ACTION_GPS_WAIT_MSG, 5000);
         }
         // time_valid is set when StratoCore::RouteRXMessage() receives a GPS message
         if (time_valid) {
@@ -53,42 +53,81 @@ void StratoRATS::FlightMode()
         if (Flight_Warmup(false)) {
             inst_substate = FL_MEASURE;
             log_nominal("Entering FL_MEASURE");
+            Flight_Measure(true);
         }
         break;
     case FL_MEASURE:
+        Flight_Measure(false);
         if(CheckAction(ACTION_REEL_OUT)) {
-            // Turn off the ECU
-            ECUControl(false);
+            // Turn off the ECU, unless it keeps measuring during the motion
+            // (it may already be off between duty cycle bursts)
+            CancelAction(ACTION_DUTY_ON);
+            reel_overlapped = ratsConfigs.reel_overlap.Read() && digitalRead(ECU_PWR_EN);
+            if (!reel_overlapped) {
+                ECUControl(false);
+            }
             mcb_motion = MOTION_REEL_OUT;
             inst_substate = FL_REEL;
             log_nominal("Entering FL_REEL (reel out)");
             // START the Flight Manual Motion state machine
             Flight_Reel(true);
         } else if (CheckAction(ACTION_REEL_IN)) {
-            // Turn off the ECU
-            ECUControl(false);
+            // Turn off the ECU, unless it keeps measuring during the motion
+            // (it may already be off between duty cycle bursts)
+            CancelAction(ACTION_DUTY_ON);
+            reel_overlapped = ratsConfigs.reel_overlap.Read() && digitalRead(ECU_PWR_EN);
+            if (!reel_overlapped) {
+                ECUControl(false);
+            }
             mcb_motion = MOTION_REEL_IN;
             inst_substate = FL_REEL;
             log_nominal("Entering FL_REEL (reel in)");
             // START the Flight Manual Motion state machine
             Flight_Reel(true);
+        } else if (CheckAction(ACTION_PROFILE_START)) {
+            CancelAction(ACTION_DUTY_ON);
+            inst_substate = FL_PROFILE;
+            log_nominal("Entering FL_PROFILE");
+            Flight_Profile(true);
         }
         break;
     case FL_REEL:
         if (Flight_Reel(false)) {
-            // Turn on the ECU
-            ECUControl(true);
-            // Start the warmup sequence
-            log_nominal("Entering FL_WARMUP");
-            Flight_Warmup(true);
-            inst_substate = FL_WARMUP;
+            if (reel_overlapped) {
+                // The ECU stayed on and warm, go straight back to measuring
+                inst_substate = FL_MEASURE;
+                log_nominal("Entering FL_MEASURE (ECU stayed on during the motion)");
+                Flight_Measure(true);
+            } else {
+                // Turn on the ECU
+                ECUControl(true);
+                // Start the warmup sequence
+                log_nominal("Entering FL_WARMUP");
+                Flight_Warmup(true);
+                inst_substate = FL_WARMUP;
+            }
+        }
+        break;
+    case FL_PROFILE:
+        if (Flight_Profile(false)) {
+            if (digitalRead(ECU_PWR_EN)) {
+                // The last leg kept the ECU on
+                inst_substate = FL_MEASURE;
+                log_nominal("Entering FL_MEASURE (profile complete)");
+                Flight_Measure(true);
+            } else {
+                ECUControl(true);
+                log_nominal("Entering FL_WARMUP (profile complete)");
+                Flight_Warmup(true);
+                inst_substate = FL_WARMUP;
+            }
         }
         break;
     case FL_ERROR:
         // generic error state for flight mode to go to if any error is detected
         // this state can make sure the ground is informed, and wait for ground intervention
         RATS_Shutdown();
-        log_debug("In Error Sub State");
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_FL_ERROR);
         break;
     case FL_SHUTDOWN:
         RATS_Shutdown();
@@ -99,7 +138,8 @@ void StratoRATS::FlightMode()
         log_nominal("Exiting FL");
         break;
     default:
-        log_error((String("Unknown substate ") + String(inst_substate) + " in FL").c_str());
+        snprintf(log_array, LOG_ARRAY_SIZE, "Unknown substate %u in FL", (unsigned)inst_substate);
+        log_error(log_array);
         break;
     }
 }
@@ -0,0 +1,95 @@
+#include "StratoRATS.h"
+
+// ECU measurement duty cycle in FL_MEASURE (ratsConfigs.duty_cycle). Each burst
+// keeps the ECU on until it has delivered the records for one RATS report
+// (ratsConfigs.duty_records, or the current report batch size if 0), or until
+// ratsConfigs.duty_on_secs has passed. The report is then sealed for sending,
+// the ECU is powered off for ratsConfigs.duty_off_secs, and the next burst
+// starts from FL_WARMUP. With the duty cycle off, the ECU stays on as before;
+// turning it off between bursts powers the ECU on through FL_WARMUP.
+
+enum MeasureStates_t {
+    MEASURE_ON,
+    MEASURE_OFF,
+};
+
+static MeasureStates_t measure_state = MEASURE_ON;
+
+void StratoRATS::Flight_Measure(bool restart)
+{
+    if (restart) {
+        measure_state = MEASURE_ON;
+        duty_burst_start = millis();
+        duty_burst_records = ecu_records;
+        CancelAction(ACTION_DUTY_ON);
+        return;
+    }
+
+    if (!ratsConfigs.duty_cycle.Read()) {
+        DutyCycleStop();
+        return;
+    }
+
+    switch (measure_state) {
+    case MEASURE_ON:
+    {
+        uint16_t target = ratsConfigs.duty_records.Read();
+        if (0 == target) {
+            target = rats_batch_records;
+        }
+        uint32_t records = ecu_records - duty_burst_records;
+        uint32_t on_ms = millis() - duty_burst_start;
+        if (records < target && on_ms < 1000UL * ratsConfigs.duty_on_secs.Read()) {
+            break;
+        }
+
+        // Seal what the burst collected, ratsReportCheck() sends it
+        const RATSReportSlot_t& slot = rats_reports[rats_fill_slot];
+        if (!slot.sealed && slot.header.num_ecu_records) {
+            ratsReportSeal();
+        }
+        ECUControl(false);
+        snprintf(log_array, LOG_ARRAY_SIZE, "Duty cycle burst: %lu records in %lu s, %lu ms ECU on per record",
+            records, on_ms / 1000, records ? on_ms / records : 0);
+        log_nominal(log_array);
+        if (records < target) {
+            ZephyrLogWarn(log_array);
+        }
+        ScheduleAction(ACTION_DUTY_ON, 1000UL * ratsConfigs.duty_off_secs.Read());
+        measure_state = MEASURE_OFF;
+        break;
+    }
+
+    case MEASURE_OFF:
+        if (CheckAction(ACTION_DUTY_ON)) {
+            ECUControl(true);
+            log_nominal("Entering FL_WARMUP (duty cycle burst)");
+            Flight_Warmup(true);
+            inst_substate = FL_WARMUP;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void StratoRATS::DutyCycleStop()
+{
+    if (MEASURE_OFF != measure_state) {
+        return;
+    }
+    CancelAction(ACTION_DUTY_ON);
+    measure_state = MEASURE_ON;
+    if (my_inst_mode != MODE_FLIGHT) {
+        return;
+    }
+    ECUControl(true);
+    ZephyrLogFine("Duty cycle off, ECU on");
+    if (inst_substate != FL_MEASURE) {
+        return;
+    }
+    log_nominal("Entering FL_WARMUP (duty cycle off)");
+    Flight_Warmup(true);
+    inst_substate = FL_WARMUP;
+}
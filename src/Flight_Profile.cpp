@@ -0,0 +1,114 @@
+#include "StratoRATS.h"
+
+// Runs the legs of the profile program in ratsConfigs.profile back-to-back.
+// Each leg is a reel motion through Flight_Reel(), followed by an optional dwell.
+// Only the last leg waits for the motion TM ACK.
+
+enum ProfileStates_t {
+    PROFILE_ENTRY,
+    PROFILE_LEG_START,
+    PROFILE_LEG_REEL,
+    PROFILE_DWELL,
+};
+
+static ProfileStates_t profile_state = PROFILE_ENTRY;
+static ProfileTable_t profile_table;
+
+bool StratoRATS::Flight_Profile(bool restart)
+{
+    if (restart) {
+        profile_state = PROFILE_ENTRY;
+    }
+
+    switch (profile_state) {
+    case PROFILE_ENTRY:
+        // Take a copy, so that TCs editing the program don't affect this run
+        profile_table = ratsConfigs.profile.Read();
+        if (0 == profile_table.num_legs || profile_table.num_legs > RATS_PROFILE_MAX_LEGS) {
+            ZephyrLogWarn("Profile has no legs");
+            log_error("Profile has no legs");
+            return true;
+        }
+        if (profile_table.leg_mask != PROFILE_ALL_LEGS(profile_table.num_legs)) {
+            ZephyrLogWarn("Profile has missing legs");
+            log_error("Profile has missing legs");
+            return true;
+        }
+        profile_leg = 0;
+        profile_abort = false;
+        snprintf(log_array, LOG_ARRAY_SIZE, "Starting profile, %u legs", profile_table.num_legs);
+        ZephyrLogFine(log_array);
+        log_nominal(log_array);
+        profile_state = PROFILE_LEG_START;
+        break;
+
+    case PROFILE_LEG_START:
+    {
+        const ProfileLeg_t& leg = profile_table.legs[profile_leg];
+        ECUControl(leg.flags & PROFILE_LEG_ECU_ON);
+        if (PROFILE_LEG_IN == leg.direction) {
+            mcb_motion = MOTION_REEL_IN;
+            retract_length = leg.length;
+        } else {
+            mcb_motion = MOTION_REEL_OUT;
+            deploy_length = leg.length;
+        }
+        motion_velocity = leg.velocity;
+        motion_decimation_override = leg.decimation;
+        reel_skip_tm_ack = (profile_leg + 1 < profile_table.num_legs);
+        snprintf(log_array, LOG_ARRAY_SIZE, "Profile leg %u of %u", profile_leg + 1, profile_table.num_legs);
+        log_nominal(log_array);
+        Flight_Reel(true);
+        profile_state = PROFILE_LEG_REEL;
+        break;
+    }
+
+    case PROFILE_LEG_REEL:
+        // Flight_Reel() sets inst_substate to MODE_ERROR on a motion failure
+        if (Flight_Reel(false)) {
+            if (profile_abort) {
+                profile_leg = profile_table.num_legs;
+                break;
+            }
+            uint16_t dwell = profile_table.legs[profile_leg].dwell_secs;
+            if (dwell) {
+                ScheduleAction(ACTION_PROFILE_DWELL, dwell * 1000UL);
+                profile_state = PROFILE_DWELL;
+            } else {
+                profile_leg++;
+                profile_state = PROFILE_LEG_START;
+            }
+        }
+        break;
+
+    case PROFILE_DWELL:
+        if (profile_abort) {
+            CancelAction(ACTION_PROFILE_DWELL);
+            profile_leg = profile_table.num_legs;
+        } else if (CheckAction(ACTION_PROFILE_DWELL)) {
+            profile_leg++;
+            profile_state = PROFILE_LEG_START;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (profile_leg >= profile_table.num_legs) {
+        if (profile_abort) {
+            ZephyrLogWarn("Profile cancelled");
+        } else {
+            ZephyrLogFine("Profile complete");
+        }
+        log_nominal(profile_abort ? "Profile cancelled" : "Profile complete");
+        motion_velocity = 0.0f;
+        motion_decimation_override = 0;
+        reel_skip_tm_ack = false;
+        profile_abort = false;
+        profile_state = PROFILE_ENTRY;
+        return true;
+    }
+
+    return false;
+}
@@ -15,21 +15,23 @@ bool StratoRATS::Flight_Reel(bool restart_state)
 {
     if (restart_state) {
         reel_state = REEL_ENTRY;
+        MCBTMAckDone();
         log_nominal("Entering REEL_ENTRY");
     }
 
-#if EXTRA_LOGGING
+#if RATS_LOG_LEVEL_MODE >= RLOG_DEBUG
     static uint old_reel_state = 256;
     if (reel_state != old_reel_state) {
-        log_nominal((String("reel_state:" + String(reel_state)).c_str()));
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_REEL_STATE, reel_state);
         old_reel_state = reel_state;
     }
 #endif
 
     switch (reel_state) {
     case REEL_ENTRY:
-        reel_state = REEL_START_MOTION;
         resend_attempted = false;
+        mcb_motion_seen = false;
+        reel_state = REEL_START_MOTION;
         log_nominal("Entering REEL_START_MOTION");
         break;
 
@@ -42,7 +44,7 @@ bool StratoRATS::Flight_Reel(bool restart_state)
         }
         if (StartMCBMotion()) {
             reel_state = REEL_VERIFY_MOTION;
-            scheduler.AddAction(RESEND_MOTION_COMMAND, MCB_RESEND_TIMEOUT);
+            ScheduleAction(RESEND_MOTION_COMMAND, MCB_RESEND_TIMEOUT * 1000UL);
             reel_state = REEL_VERIFY_MOTION;
             log_nominal("Entering REEL_VERIFY_MOTION");
         } else {
@@ -56,23 +58,27 @@ bool StratoRATS::Flight_Reel(bool restart_state)
     case REEL_VERIFY_MOTION:
         if (mcb_motion_ongoing) { // set in the Ack handler
             log_nominal("MCB commanded motion");
+            CancelAction(RESEND_MOTION_COMMAND);
             // max_reel_seconds was set in StartMCBMotion()
-            scheduler.AddAction(ACTION_MOTION_TIMEOUT, max_reel_seconds);
+            ScheduleAction(ACTION_MOTION_TIMEOUT, max_reel_seconds * 1000UL);
             reel_state = REEL_MONITOR_MOTION;
             log_nominal("Entering REEL_MONITOR_MOTION");
         }
+        // The command queue does not resend motion commands: resend once, and
+        // only if the MCB has not sent motion TM (the ACK may have been lost)
         if (CheckAction(RESEND_MOTION_COMMAND)) {
-            if (!resend_attempted) {
+            if (!resend_attempted && !mcb_motion_seen) {
                 resend_attempted = true;
+                ZephyrLogWarn("MCB did not confirm motion, resending");
+                log_error("MCB did not confirm motion, resending");
                 reel_state = REEL_START_MOTION;
                 log_nominal("Entering REEL_START_MOTION");
-            } else {
-                resend_attempted = false;
-                ZephyrLogWarn("MCB never confirmed motion");
-                log_error("MCB never confirmed motion");
-                inst_substate = MODE_ERROR; // will force exit of Flight_Profile
-                log_error("Entering MODE_ERROR");
+                break;
             }
+            ZephyrLogWarn("MCB never confirmed motion");
+            log_error("MCB never confirmed motion");
+            inst_substate = MODE_ERROR; // will force exit of Flight_Profile
+            log_error("Entering MODE_ERROR");
         }
         break;
 
@@ -83,33 +89,56 @@ bool StratoRATS::Flight_Reel(bool restart_state)
             return true;
             break;
         }
+        MotionHealthWatchdog();
+        if (CheckAction(ACTION_MOTION_HEALTH)) {
+            // Cancel as soon as the monitor sees the reel misbehave, instead of waiting for the timeout
+            SendMCBTM(CRIT, motion_health.msg);
+            log_error(motion_health.msg);
+            MCBCommand(MCB_CANCEL_MOTION, 0.0f, 0.0f, true);
+            CancelAction(ACTION_MOTION_TIMEOUT);
+            inst_substate = MODE_ERROR; // will force exit of Flight_Profile
+            log_error("Entering MODE_ERROR");
+            break;
+        }
         if (CheckAction(ACTION_MOTION_TIMEOUT)) {
             SendMCBTM(CRIT, "MCB Motion took longer than expected");
             log_error("MCB Motion took longer than expected");
-            mcbComm.TX_ASCII(MCB_CANCEL_MOTION);
+            MCBCommand(MCB_CANCEL_MOTION, 0.0f, 0.0f, true);
             inst_substate = MODE_ERROR; // will force exit of Flight_Profile
             log_error("Entering MODE_ERROR");
             break;
         }
         if (!mcb_motion_ongoing) {
+            // The next profile leg follows right away, don't hold it up for the ACK
+            mcb_tm_ack_wait = !reel_skip_tm_ack;
             SendMCBTM(FINE, "Finished commanded reel motion");
+            if (reel_skip_tm_ack) {
+                return true;
+            }
             reel_state = REEL_TM_ACK;
-            scheduler.AddAction(RESEND_TM, ZEPHYR_RESEND_TIMEOUT);
+            ScheduleAction(RESEND_TM, ZEPHYR_RESEND_TIMEOUT * 1000UL);
             log_nominal("Entering REEL_TM_ACK");
         }
         break;
 
     case REEL_TM_ACK:
-        if (ACK == TM_ack_flag) {
+    {
+        // The ACK is matched to the motion TM frame, not to whichever TM was sent last
+        TMTXStatus_t status = TMStatus(mcb_tm_frame);
+        if (TM_TX_ACKED == status) {
             log_nominal("Zephyr ACKed motion TM");
+            CancelAction(RESEND_TM);
+            MCBTMAckDone();
             return true;
-        } else if (NAK == TM_ack_flag || CheckAction(RESEND_TM)) {
-            // attempt one resend
+        } else if (TM_TX_NAKED == status || CheckAction(RESEND_TM)) {
+            // attempt one resend, of the motion TM kept in MCB_TM_buffer
+            CancelAction(RESEND_TM);
             log_error("Needed to resend TM");
-            zephyrTX.TM(); // message is still saved in XMLWriter, no need to reconstruct
+            ResendMCBTM();
             return true;
         }
         break;
+    }
 
     default:
         // unknown state, exit
@@ -1,19 +1,21 @@
 #include "StratoRATS.h"
-#include <ArduinoJson.h>
+
+// The warmup waits for the ECU to send ratsConfigs.warmup_msgs good frames,
+// then sends it its config. The LoRa frames drive the state machine:
+// WarmupLoRaFrame() is called by LoRaRX() for each frame, and moves to the
+// next state as soon as the frame that completes it arrives. Flight_Warmup()
+// runs on the mode tick only for the entry and the timeouts.
 
 enum WarmupStates_t
 {
     WARMUP_ENTRY,
     WARMUP_LORA_WAIT1,
-    WARMUP_CONFIG_ECU,
-    WARMUP_LORA_WAIT2
+    WARMUP_LORA_WAIT2,
+    WARMUP_DONE
 };
 
 static WarmupStates_t warmup_state = WARMUP_ENTRY;
 
-static JsonDocument ecu_json;
-static char ecu_json_str[ECU_LORA_DATA_BUFSIZE];
-
 bool StratoRATS::Flight_Warmup(bool restart)
 {
     if (restart)
@@ -23,10 +25,10 @@ bool StratoRATS::Flight_Warmup(bool restart)
         warmup_cycles = 0;
     }
 
-#if EXTRA_LOGGING
+#if RATS_LOG_LEVEL_MODE >= RLOG_DEBUG
     static uint old_warmup_state = 256;
     if (warmup_state != old_warmup_state) {
-        log_nominal((String("warmup_state:" + String(warmup_state)).c_str()));
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_WARMUP_STATE, warmup_state);
         old_warmup_state = warmup_state;
     }
 #endif
@@ -36,15 +38,17 @@ bool StratoRATS::Flight_Warmup(bool restart)
     case WARMUP_ENTRY:
         // Power on ECU
         log_nominal("WARMUP_ENTRY Powering on ECU");
-        // Start the LoRa message counter
-        lora_count_check(true);
+        // WarmupLoRaFrame() counts the ECU frames that meet the warmup thresholds,
+        // and moves the warmup along as they arrive
+        warmup_good_frames = 0;
+        warmup_listening = true;
         LoRaMsg_timer_start = now();
-        scheduler.AddAction(ACTION_LORA_COUNT_MSGS, 1);
         warmup_state = WARMUP_LORA_WAIT1;
         log_nominal("Entering WARMUP_WAIT1");
         break;
 
     case WARMUP_LORA_WAIT1:
+        // Only the timeout is checked here
         if (LoRaMsg_timer_start + LORA_WARMUP_MSG_TIMEOUT < now())
         {
             warmup_cycles++;
@@ -52,60 +56,18 @@ bool StratoRATS::Flight_Warmup(bool restart)
             {
                 log_error("WARMUP_LORA_WAIT1 Too many LoRa message timeouts");
                 ZephyrLogCrit("LoRa message timeouts during warmup wait1");
+                warmup_listening = false;
                 warmup_status = WARMUP_FAILED;
+                warmup_state = WARMUP_DONE;
                 return(true);
             }
-            else
-            {
-                warmup_state = WARMUP_ENTRY;
-                log_nominal("Re-entering WARMUP_ENTRY");
-                return(false);
-            }
+            // Keep the frames counted so far, and wait another timeout period
+            log_nominal("WARMUP_LORA_WAIT1 LoRa message timeout, waiting again");
+            LoRaMsg_timer_start = now();
         }
-        else
-        {
-            if (CheckAction(ACTION_LORA_COUNT_MSGS))
-            {
-                // Wait for enough LoRa message to arrive.
-                if (lora_count_check() >= LORA_MSG_COUNT)
-                {
-                    log_nominal("WARMUP_LORA_WAIT1 Required LoRa messages received");
-                    warmup_state = WARMUP_CONFIG_ECU;
-                    log_nominal("Entering WARMUP_CONFIG_ECU");
-                }
-                else
-                {
-                    scheduler.AddAction(ACTION_LORA_COUNT_MSGS, 1);
-                }
-            }
-        }
-        break;
-    case WARMUP_CONFIG_ECU:
-        // Configure the ECU here.
-        log_nominal("WARMUP_CONFIG_ECU Configuring ECU");
-        // TODO: Send all of the ECU config parameters in one JSON message, 
-        // since we are only allowed to send one message at a time.
-        // TODO: Abstract the ECU configuration into a separate function,
-        // with flexibility to set any collection of parameters. This can be
-        // shared with the TC handler.
-        ecu_json["tempC"] = ratsConfigs.ecu_tempC.Read();
-        serializeJson(ecu_json, ecu_json_str);
-        log_nominal((String("ECU command: ") + ecu_json_str).c_str());
-        // Send the configuration message to the ECU
-        // Don't forget that the message will not be sent until we receive a message from the ECU.
-        // So it will not work to try to send two messages back-to-back.
-        ecu_lora_tx((uint8_t*)ecu_json_str, strlen(ecu_json_str));
-
-        LoRaMsg_timer_start = now();
-        warmup_cycles = 0;
-        scheduler.AddAction(ACTION_LORA_COUNT_MSGS, 1);
-        warmup_state = WARMUP_LORA_WAIT2;
-        // Start the LoRa message counter
-        lora_count_check(true);
-        log_nominal("Entering WARMUP_LORA_WAIT2");
-        log_nominal("WARMUP_LORA_WAIT2 waiting for LoRa message");
         break;
     case WARMUP_LORA_WAIT2:
+        // Only the timeout is checked here
         if (LoRaMsg_timer_start + LORA_WARMUP_MSG_TIMEOUT < now())
         {
             warmup_cycles++;
@@ -113,40 +75,88 @@ bool StratoRATS::Flight_Warmup(bool restart)
             {
                 log_error("WARMUP_LORA_WAIT2 Too many LoRa message timeouts");
                 ZephyrLogCrit("LoRa message timeouts during warmup wait2");
+                warmup_listening = false;
                 warmup_status = WARMUP_FAILED;
+                warmup_state = WARMUP_DONE;
                 return(true);
             }
-            else
-            {
-                warmup_state = WARMUP_ENTRY;
-                log_nominal("Re-entering WARMUP_ENTRY");
-                return(false);
-            }
-        }
-        else
-        {
-            if (CheckAction(ACTION_LORA_COUNT_MSGS))
-            {
-                // Wait for enough LoRa messages to arrive.
-                if (lora_count_check() >= LORA_MSG_COUNT)
-                {
-                    log_nominal("WARMUP_LORA_WAIT2 Required LoRa messages received");
-                    ZephyrLogFine("Warmup complete");
-                    warmup_status = WARMUP_COMPLETE;
-                    return true;
-                }
-                else
-                {
-                    scheduler.AddAction(ACTION_LORA_COUNT_MSGS, 1);
-                }
-            }
+            // Send the config again; the frames that follow it show that it went out
+            log_nominal("WARMUP_LORA_WAIT2 LoRa message timeout, resending ECU config");
+            ECUConfigSend();
+            LoRaMsg_timer_start = now();
         }
         break;
+    case WARMUP_DONE:
+        break;
 
     default:
         // unknown state, move on!
         return true;
     }
 
-    return false; //  // remain in this mode, unless we have changed inst_substate
-}
\ No newline at end of file
+    // Set by WarmupLoRaFrame() as soon as the ECU is ready
+    return (WARMUP_COMPLETE == warmup_status);
+}
+
+bool StratoRATS::WarmupRecordReady(const LoRaFrame_t& frame)
+{
+    // A short frame is not a full ECU report
+    if (frame.msg.data_len != ECU_REPORT_SIZE_BYTES) {
+        return false;
+    }
+
+    // The ECU sends zeroed reports until its first measurement
+    for (uint i = 0; i < ECU_REPORT_SIZE_BYTES; i++) {
+        if (frame.msg.data[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StratoRATS::WarmupLoRaFrame(const LoRaFrame_t& frame)
+{
+    if (!warmup_listening) {
+        return;
+    }
+
+    switch (warmup_state)
+    {
+    case WARMUP_LORA_WAIT1:
+        if (frame.rssi >= ratsConfigs.warmup_min_rssi.Read() &&
+            frame.snr >= ratsConfigs.warmup_min_snr.Read() &&
+            WarmupRecordReady(frame)) {
+            warmup_good_frames++;
+        }
+        if (warmup_good_frames < ratsConfigs.warmup_msgs.Read()) {
+            break;
+        }
+        log_nominal("WARMUP_LORA_WAIT1 Required LoRa messages received");
+
+        // Configure the ECU here. All parameters go in one downlink, 
+        // along with any changes queued by TCs. It goes out with the reply
+        // to this frame.
+        log_nominal("WARMUP_CONFIG_ECU Configuring ECU");
+        ECUConfigSet(ECU_CONFIG_TEMPC, ratsConfigs.ecu_tempC.Read());
+        ECUConfigSend();
+
+        LoRaMsg_timer_start = now();
+        warmup_cycles = 0;
+        warmup_state = WARMUP_LORA_WAIT2;
+        log_nominal("Entering WARMUP_LORA_WAIT2");
+        log_nominal("WARMUP_LORA_WAIT2 waiting for the ECU config to be sent");
+        break;
+    case WARMUP_LORA_WAIT2:
+        // LoRaRX() has already passed this frame to ECUConfigCheck()
+        if (ECUConfigIdle()) {
+            log_nominal("WARMUP_LORA_WAIT2 ECU config sent");
+            ZephyrLogFine("Warmup complete");
+            warmup_listening = false;
+            warmup_status = WARMUP_COMPLETE;
+            warmup_state = WARMUP_DONE;
+        }
+        break;
+    default:
+        break;
+    }
+}
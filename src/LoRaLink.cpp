@@ -0,0 +1,242 @@
+#include "StratoRATS.h"
+#include <LoRa.h>
+
+// LoRa link quality and adaptive data rate. LoRaLinkFrame() keeps rolling
+// RSSI, SNR and radio loss stats for each received frame; they go in the RATS
+// report header. With ratsConfigs.lora_adaptive set, LoRaLinkService() moves
+// the ECU along lora_link_steps[] (fastest first) using the SNR margin over
+// the demodulation floor:
+//  - margin below LORA_LINK_MARGIN_LOW_DB, or loss above LORA_LINK_LOSS_HIGH:
+//    raise the ECU TX power, then step to a slower rate
+//  - predicted margin at the next faster rate above LORA_LINK_MARGIN_HIGH_DB:
+//    step to the faster rate, and at the fastest rate lower the ECU TX power
+// A change is sent with the ECU config queue (ECUConfig.cpp). The ECU switches
+// after the uplink that carries the downlink, so the RATS radio follows
+// LORA_LINK_SWITCH_DELAY_MS after that uplink. The rate change is a handshake:
+//  - the first uplink received on the new rate confirms that the ECU switched
+//  - RATS then resends the SF and BW on the new rate, which tells the ECU that
+//    RATS follows; the rate is kept once that downlink has gone out
+// If nothing is received on the new rate for LORA_LINK_FALLBACK_MS, both sides
+// return to the boot rate, which they always agree on. This needs the ECU to
+// return to its boot SF, BW and TX power when a rate change is not confirmed
+// by a downlink on the new rate within LORA_LINK_ECU_CONFIRM_MS. The ECU also
+// starts at the boot rate when it is powered on.
+
+struct LoRaLinkStep_t {
+    uint8_t sf;
+    uint32_t bw;
+    // The SNR demodulation floor for sf, dB
+    float floor_db;
+    // 10log10(bw/125 kHz), the noise increase with bandwidth
+    float noise_db;
+};
+
+static const LoRaLinkStep_t lora_link_steps[] = {
+    {7,  500000,  -7.5f, 6.0f},
+    {7,  250000,  -7.5f, 3.0f},
+    {8,  250000, -10.0f, 3.0f},
+    {9,  250000, -12.5f, 3.0f},
+    {10, 250000, -15.0f, 3.0f},
+    {11, 250000, -17.5f, 3.0f},
+    {12, 250000, -20.0f, 3.0f},
+};
+#define NUM_LORA_LINK_STEPS (sizeof(lora_link_steps) / sizeof(lora_link_steps[0]))
+
+void LoRaLinkStats_t::Add(int16_t frame_rssi, float frame_snr, uint32_t lost)
+{
+    if (0 == frames) {
+        rssi = frame_rssi;
+        snr = frame_snr;
+    } else {
+        rssi += (frame_rssi - rssi) / LORA_LINK_AVERAGE;
+        snr += (frame_snr - snr) / LORA_LINK_AVERAGE;
+    }
+    frames++;
+
+    // Halve the counts to keep roughly the last LORA_LINK_WINDOW frames
+    window_rx++;
+    window_lost += lost;
+    if (window_rx + window_lost > LORA_LINK_WINDOW) {
+        window_rx = (window_rx + 1) / 2;
+        window_lost /= 2;
+    }
+}
+
+void StratoRATS::LoRaLinkInit()
+{
+    lora_link_boot_step = NUM_LORA_LINK_STEPS;
+    for (uint8_t i = 0; i < NUM_LORA_LINK_STEPS; i++) {
+        if (lora_link_steps[i].sf == SF && lora_link_steps[i].bw == BANDWIDTH) {
+            lora_link_boot_step = i;
+        }
+    }
+    if (lora_link_boot_step == NUM_LORA_LINK_STEPS) {
+        log_error("LoRa boot SF/BW is not a link step, adaptive rate disabled");
+        lora_link_boot_step = 0;
+        lora_link_fixed = true;
+    }
+    lora_link_step = lora_link_boot_step;
+    LoRaLinkReset();
+}
+
+void StratoRATS::LoRaLinkReset()
+{
+    if (lora_link_step != lora_link_boot_step) {
+        LoRaLinkApply(lora_link_boot_step);
+    }
+    lora_link_request_step = lora_link_boot_step;
+    lora_link_ecu_txp = TX_POWER;
+    lora_link_request_pending = false;
+    lora_link_switch_millis = 0;
+    lora_link_verify = false;
+    lora_link_heard = false;
+    lora_link_confirm_sent = false;
+    lora_link = LoRaLinkStats_t();
+}
+
+void StratoRATS::LoRaLinkFrame(const LoRaFrame_t& frame, uint32_t lost)
+{
+    lora_link.Add(frame.rssi, frame.snr, lost);
+    lora_link_rx_millis = millis();
+    // The ECU is on the new rate, LoRaLinkService() sends the confirmation
+    if (lora_link_verify) {
+        lora_link_heard = true;
+    }
+
+    // The requested change went down with the previous uplink's reply
+    if (lora_link_request_pending && total_lora_count != ecu_config_sent_count) {
+        lora_link_request_pending = false;
+        lora_link_switch_millis = millis();
+    }
+}
+
+void StratoRATS::LoRaLinkService()
+{
+    uint32_t now_ms = millis();
+
+    if (lora_link_switch_millis && now_ms - lora_link_switch_millis >= LORA_LINK_SWITCH_DELAY_MS) {
+        lora_link_switch_millis = 0;
+        LoRaLinkApply(lora_link_request_step);
+        lora_link_rx_millis = now_ms;
+        lora_link_verify = true;
+        lora_link_heard = false;
+        lora_link_confirm_sent = false;
+        return;
+    }
+
+    if (lora_link_verify && now_ms - lora_link_rx_millis >= LORA_LINK_FALLBACK_MS) {
+        const LoRaLinkStep_t& step = lora_link_steps[lora_link_boot_step];
+        snprintf(log_array, LOG_ARRAY_SIZE, "LoRa link lost at SF%u, back to the boot rate SF%u BW %lu kHz",
+            lora_link_steps[lora_link_step].sf, step.sf, step.bw / 1000);
+        ZephyrLogWarn(log_array);
+        log_error(log_array);
+        // The ECU falls back to the boot rate and TX power on its own
+        LoRaLinkApply(lora_link_boot_step);
+        lora_link_request_step = lora_link_boot_step;
+        lora_link_ecu_txp = TX_POWER;
+        lora_link_verify = false;
+        // The change will not be sent on this rate
+        ecu_config_pending &= ~LORA_LINK_CONFIG_MASK;
+        ecu_config_sent &= ~LORA_LINK_CONFIG_MASK;
+        return;
+    }
+
+    if (lora_link_verify) {
+        if (lora_link_heard && !lora_link_confirm_sent && ECUConfigIdle()) {
+            const LoRaLinkStep_t& step = lora_link_steps[lora_link_step];
+            ECUConfigSet(ECU_CONFIG_LORA_SF, step.sf);
+            ECUConfigSet(ECU_CONFIG_LORA_BW, step.bw);
+            lora_link_confirm_sent = ECUConfigSend();
+        } else if (lora_link_confirm_sent && ECUConfigIdle()) {
+            snprintf(log_array, LOG_ARRAY_SIZE, "LoRa link: SF%u BW %lu kHz confirmed",
+                lora_link_steps[lora_link_step].sf, lora_link_steps[lora_link_step].bw / 1000);
+            ZephyrLogFine(log_array);
+            log_nominal(log_array);
+            lora_link_verify = false;
+        }
+        return;
+    }
+
+    if (lora_link_fixed || !ratsConfigs.lora_adaptive.Read() || !digitalRead(ECU_PWR_EN)) {
+        return;
+    }
+    if (lora_link_request_pending || lora_link_switch_millis || lora_link_verify
+        || warmup_listening || !ECUConfigIdle() || lora_link.frames < LORA_LINK_MIN_FRAMES) {
+        return;
+    }
+
+    const LoRaLinkStep_t& step = lora_link_steps[lora_link_step];
+    float margin = lora_link.snr - step.floor_db;
+    float loss = lora_link.LossRate();
+
+    if (margin < LORA_LINK_MARGIN_LOW_DB || loss > LORA_LINK_LOSS_HIGH) {
+        if (lora_link_ecu_txp < TX_POWER) {
+            lora_link_ecu_txp = min(lora_link_ecu_txp + LORA_LINK_TXP_STEP_DB, TX_POWER);
+            LoRaLinkRequest(lora_link_step);
+        } else if (lora_link_step + 1 < NUM_LORA_LINK_STEPS) {
+            LoRaLinkRequest(lora_link_step + 1);
+        }
+    } else if (loss <= LORA_LINK_LOSS_LOW) {
+        if (lora_link_step > 0) {
+            // The SNR falls with the noise of a wider bandwidth
+            const LoRaLinkStep_t& faster = lora_link_steps[lora_link_step - 1];
+            float faster_margin = lora_link.snr + step.noise_db - faster.noise_db - faster.floor_db;
+            if (faster_margin >= LORA_LINK_MARGIN_HIGH_DB) {
+                LoRaLinkRequest(lora_link_step - 1);
+            }
+        } else if (margin - LORA_LINK_TXP_STEP_DB >= LORA_LINK_MARGIN_HIGH_DB
+            && lora_link_ecu_txp - LORA_LINK_TXP_STEP_DB >= LORA_LINK_MIN_TXP) {
+            lora_link_ecu_txp -= LORA_LINK_TXP_STEP_DB;
+            LoRaLinkRequest(lora_link_step);
+        }
+    }
+}
+
+void StratoRATS::LoRaLinkRequest(uint8_t step_index)
+{
+    const LoRaLinkStep_t& step = lora_link_steps[step_index];
+
+    ECUConfigSet(ECU_CONFIG_LORA_SF, step.sf);
+    ECUConfigSet(ECU_CONFIG_LORA_BW, step.bw);
+    ECUConfigSet(ECU_CONFIG_LORA_TXP, lora_link_ecu_txp);
+    if (!ECUConfigSend()) {
+        return;
+    }
+
+    snprintf(log_array, LOG_ARRAY_SIZE, "LoRa link: SF%u BW %lu kHz ECU %d dBm requested, SNR %.1f dB, loss %.1f%%",
+        step.sf, step.bw / 1000, lora_link_ecu_txp, lora_link.snr, 100.0f * lora_link.LossRate());
+    ZephyrLogFine(log_array);
+    log_nominal(log_array);
+
+    // A TX power change alone does not change the RATS radio
+    lora_link_request_step = step_index;
+    lora_link_request_pending = (step_index != lora_link_step);
+    lora_link.frames = 0;
+}
+
+void StratoRATS::LoRaLinkApply(uint8_t step_index)
+{
+    const LoRaLinkStep_t& step = lora_link_steps[step_index];
+
+    LoRaMaskISR();
+    LoRa.idle();
+    LoRa.setSpreadingFactor(step.sf);
+    LoRa.setSignalBandwidth(step.bw);
+    LoRa.receive();
+    LoRaUnmaskISR();
+    lora_link_step = step_index;
+    lora_link.frames = 0;
+
+    snprintf(log_array, LOG_ARRAY_SIZE, "LoRa radio set to SF%u BW %lu kHz", step.sf, step.bw / 1000);
+    log_nominal(log_array);
+}
+
+uint8_t StratoRATS::LoRaLinkSF() const
+{
+    return lora_link_steps[lora_link_step].sf;
+}
+
+uint8_t StratoRATS::LoRaLinkBW() const
+{
+    return lora_link_steps[lora_link_step].bw / 125000;
+}
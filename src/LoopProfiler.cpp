@@ -0,0 +1,121 @@
+/*
+ *  LoopProfiler.cpp
+ *
+ *  Main loop stage timing, see LoopProfiler.h
+ */
+
+#include "LoopProfiler.h"
+
+static const uint32_t hist_edges_us[LOOP_HIST_BINS-1] = LOOP_HIST_EDGES_US;
+
+// Heap allocation counting, needs -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+static volatile uint32_t heap_allocs = 0;
+
+#ifdef RATS_HEAP_COUNT
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    heap_allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    heap_allocs++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    heap_allocs++;
+    return __real_realloc(ptr, size);
+}
+}
+#endif
+
+uint32_t HeapAllocCount()
+{
+    return heap_allocs;
+}
+
+LoopProfiler::LoopProfiler(uint32_t period_us)
+    : period_us(period_us)
+{
+    Reset();
+}
+
+void LoopProfiler::Add(LoopStage_t stage, uint32_t cycles)
+{
+    if (stage >= NUM_LOOP_STAGES) {
+        return;
+    }
+
+    // F_CPU_ACTUAL changes in low power mode
+    uint32_t us = cycles / (F_CPU_ACTUAL / 1000000);
+    StageStats_t& s = stats[stage];
+    s.count++;
+    s.total_us += us;
+    if (us < s.min_us) {
+        s.min_us = us;
+    }
+    if (us > s.max_us) {
+        s.max_us = us;
+    }
+
+    uint8_t bin = 0;
+    while (bin < LOOP_HIST_BINS-1 && us >= hist_edges_us[bin]) {
+        bin++;
+    }
+    if (s.hist[bin] < UINT16_MAX) {
+        s.hist[bin]++;
+    }
+
+    if (STAGE_TICK == stage && us > period_us) {
+        overrun_ticks++;
+    }
+}
+
+void LoopProfiler::AddAllocs(uint32_t allocs)
+{
+    if (allocs) {
+        alloc_loops++;
+        loop_allocs += allocs;
+    }
+}
+
+void LoopProfiler::Reset()
+{
+    for (uint8_t i = 0; i < NUM_LOOP_STAGES; i++) {
+        stats[i].count = 0;
+        stats[i].min_us = UINT32_MAX;
+        stats[i].max_us = 0;
+        stats[i].total_us = 0;
+        for (uint8_t j = 0; j < LOOP_HIST_BINS; j++) {
+            stats[i].hist[j] = 0;
+        }
+    }
+    overrun_ticks = 0;
+    missed_ticks = 0;
+    alloc_loops = 0;
+    loop_allocs = 0;
+}
+
+uint32_t LoopProfiler::MinUs(LoopStage_t stage) const
+{
+    return stats[stage].count ? stats[stage].min_us : 0;
+}
+
+uint32_t LoopProfiler::MaxUs(LoopStage_t stage) const
+{
+    return stats[stage].max_us;
+}
+
+uint32_t LoopProfiler::MeanUs(LoopStage_t stage) const
+{
+    return stats[stage].count ? stats[stage].total_us / stats[stage].count : 0;
+}
@@ -0,0 +1,85 @@
+/*
+ *  LoopProfiler.h
+ *
+ *  Measures the time spent in each stage of the main loop with the ARM DWT
+ *  cycle counter. For each stage it keeps min/max/mean and a histogram, and
+ *  it counts control loop ticks that took longer than the loop period. Each
+ *  sample is converted to microseconds at the clock rate it was taken at, so
+ *  stats that span a low power clock change stay comparable.
+ *
+ *  It also counts heap allocations made by each pass through the loop. The
+ *  diagnostic PlatformIO envs (rats_heap_count, rats_bench) wrap
+ *  malloc/calloc/realloc (RATS_HEAP_COUNT and -Wl,--wrap, see platformio.ini)
+ *  so that every allocation, including String and new, is counted. The flight
+ *  envs don't wrap them, and the count stays 0.
+ */
+
+#ifndef LOOPPROFILER_H
+#define LOOPPROFILER_H
+
+#include <Arduino.h>
+
+enum LoopStage_t : uint8_t {
+    STAGE_WATCHDOG,
+    STAGE_SCHEDULER,
+    STAGE_ZEPHYR_ROUTER,
+    STAGE_MCB_ROUTER,
+    STAGE_LORA,
+    STAGE_MODE,
+    STAGE_INSTRUMENT,
+    // A complete control loop tick
+    STAGE_TICK,
+    NUM_LOOP_STAGES
+};
+
+// Histogram bin upper edges in microseconds, the last bin collects everything above
+#define LOOP_HIST_BINS 8
+#define LOOP_HIST_EDGES_US {10, 100, 1000, 10000, 50000, 100000, 500000}
+
+// Total heap allocations since boot, always 0 without RATS_HEAP_COUNT
+uint32_t HeapAllocCount();
+
+struct StageStats_t {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint16_t hist[LOOP_HIST_BINS];
+};
+
+class LoopProfiler {
+public:
+    // period_us is the control loop period, used to detect overruns
+    LoopProfiler(uint32_t period_us);
+
+    // Start timing a stage
+    void Start() { start_cycles = ARM_DWT_CYCCNT; }
+    // Stop timing, and add the elapsed time since Start() to stage
+    void Stop(LoopStage_t stage) { Add(stage, ARM_DWT_CYCCNT - start_cycles); }
+    // Add a measurement for stage, in cycles of the current clock
+    void Add(LoopStage_t stage, uint32_t cycles);
+    // Add the heap allocations made during one pass through the loop
+    void AddAllocs(uint32_t allocs);
+    // Clear all statistics
+    void Reset();
+
+    // Statistics in microseconds
+    uint32_t MinUs(LoopStage_t stage) const;
+    uint32_t MaxUs(LoopStage_t stage) const;
+    uint32_t MeanUs(LoopStage_t stage) const;
+
+    StageStats_t stats[NUM_LOOP_STAGES];
+    // Ticks that took longer than the loop period
+    uint32_t overrun_ticks = 0;
+    // Ticks posted while the previous one was still pending (i.e. missed)
+    volatile uint32_t missed_ticks = 0;
+    // Loop passes that allocated from the heap, and the total allocations they made
+    uint32_t alloc_loops = 0;
+    uint32_t loop_allocs = 0;
+
+private:
+    uint32_t period_us;
+    uint32_t start_cycles = 0;
+};
+
+#endif /* LOOPPROFILER_H */
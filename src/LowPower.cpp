@@ -1,4 +1,7 @@
 #include "StratoRATS.h"
+#include <LoRa.h>
+
+extern "C" uint32_t set_arm_clock(uint32_t frequency);
 
 enum LPStates_t : uint8_t {
     LP_ENTRY = MODE_ENTRY,
@@ -18,12 +21,13 @@ void StratoRATS::LowPowerMode()
         // perform setup
         log_nominal("Entering LP");
         RATS_Shutdown();
+        LowPowerEnter();
         inst_substate = LP_LOOP;
         log_nominal("Entering LP_LOOP");
         break;
     case LP_LOOP:
         // nominal ops
-        log_debug("LP loop");
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_LP_LOOP);
         break;
     case LP_SHUTDOWN:
         // prep for shutdown
@@ -32,6 +36,7 @@ void StratoRATS::LowPowerMode()
         break;
     case LP_EXIT:
         // perform cleanup
+        LowPowerExit();
         log_nominal("Exiting LP");
         break;
     default:
@@ -42,3 +47,72 @@ void StratoRATS::LowPowerMode()
         break;
     }
 }
+
+void StratoRATS::LowPowerEnter()
+{
+    MCBCommand(MCB_GO_LOW_POWER);
+    LoRaMaskISR();
+    LoRa.sleep();
+    LoRaUnmaskISR();
+
+    // The UARTs run from the 24 MHz oscillator, so queued output is not affected
+    set_arm_clock(LOW_POWER_CPU_HZ);
+
+    lp_enter_millis = millis();
+    lp_sleep_us = 0;
+    lp_sleeping = true;
+    snprintf(log_array, LOG_ARRAY_SIZE, "Low power: core at %lu MHz, sleeping between events", F_CPU_ACTUAL / 1000000);
+    log_nominal(log_array);
+}
+
+void StratoRATS::LowPowerExit()
+{
+    if (!lp_sleeping) {
+        return;
+    }
+    lp_sleeping = false;
+    set_arm_clock(F_CPU);
+    // Back to continuous receive, LoRaRX() picks up the frames again
+    LoRaMaskISR();
+    LoRa.receive();
+    LoRaUnmaskISR();
+    mcb_low_power = false;
+
+    uint32_t elapsed_ms = millis() - lp_enter_millis;
+    snprintf(log_array, LOG_ARRAY_SIZE, "Low power: slept %lu of %lu s, wake tick/zephyr/mcb/lora max %lu/%lu/%lu/%lu us",
+        (uint32_t)(lp_sleep_us / 1000000), elapsed_ms / 1000,
+        wake_latency[0].max_us, wake_latency[1].max_us, wake_latency[2].max_us, wake_latency[3].max_us);
+    ZephyrLogFine(log_array);
+    log_nominal(log_array);
+}
+
+void StratoRATS::LowPowerIdle()
+{
+    if (!lp_sleeping || rats_log.Used()) {
+        return;
+    }
+
+    // With interrupts masked, an interrupt that arrives after the checks still ends
+    // the WFI, and its handler runs when they are unmasked
+    noInterrupts();
+    if (!pending_events && !ZEPHYR_SERIAL.available() && !MCB_SERIAL.available()) {
+        uint32_t start = micros();
+        asm volatile("dsb\n\twfi");
+        lp_sleep_us += micros() - start;
+    }
+    interrupts();
+}
+
+void StratoRATS::LowPowerWake(uint8_t events)
+{
+    if (!lp_sleeping) {
+        return;
+    }
+
+    uint32_t t = micros();
+    for (uint8_t i = 0; i < NUM_RATS_EVENTS; i++) {
+        if (events & (1 << i)) {
+            wake_latency[i].Add(t - event_micros[i]);
+        }
+    }
+}
@@ -0,0 +1,249 @@
+#include "StratoRATS.h"
+
+// Outbound MCB command queue. Commands are sent in order with up to
+// MCB_MAX_IN_FLIGHT awaiting their ACK, and at most one of each MCB message id
+// in flight, so that an ACK always matches one request. An unACKed idempotent
+// command is resent after MCB_ACK_TIMEOUT_MS, doubling for each retry, and
+// dropped after MCB_MAX_RETRIES. The motion and zero commands are not: a lost
+// ACK may hide a motion that started, so they are sent once and dropped after
+// MCB_NO_RETRY_HOLD_MS. Flight_Reel() resends a motion command once, and only
+// if no motion was seen. An urgent command is never dropped: with the queue
+// full it evicts the newest command not yet sent, or is sent untracked. The
+// round-trip time of each command is kept in mcb_cmd_stats.
+
+// The MCB commands sent by RATS, their float parameter count, and whether the
+// queue resends them
+const MCBCommandEntry_t StratoRATS::mcb_cmd_table[NUM_MCB_COMMANDS] = {
+    {MCB_CANCEL_MOTION,     "cancel motion",    0,  true},
+    {MCB_REEL_IN,           "reel in",          2,  false},
+    {MCB_REEL_OUT,          "reel out",         2,  false},
+    {MCB_IN_NO_LW,          "in no LW",         2,  false},
+    {MCB_IN_ACC,            "retract acc",      1,  true},
+    {MCB_OUT_ACC,           "deploy acc",       1,  true},
+    {MCB_ZERO_REEL,         "zero reel",        0,  false},
+    {MCB_TORQUE_LIMITS,     "torque limits",    2,  true},
+    {MCB_CURR_LIMITS,       "curr limits",      2,  true},
+    {MCB_IGNORE_LIMITS,     "ignore limits",    0,  true},
+    {MCB_USE_LIMITS,        "use limits",       0,  true},
+    {MCB_GET_EEPROM,        "get EEPROM",       0,  true},
+    {MCB_GET_VOLTAGES,      "get voltages",     0,  true},
+    {MCB_CONTROLLERS_ON,    "controllers on",   0,  true},
+    {MCB_CONTROLLERS_OFF,   "controllers off",  0,  true},
+    {MCB_GO_LOW_POWER,      "go low power",     0,  true},
+};
+
+bool StratoRATS::MCBCommand(uint8_t msg_id, float param0, float param1, bool urgent)
+{
+    uint8_t command = NUM_MCB_COMMANDS;
+    for (uint8_t i = 0; i < NUM_MCB_COMMANDS; i++) {
+        if (mcb_cmd_table[i].msg_id == msg_id) {
+            command = i;
+            break;
+        }
+    }
+    if (NUM_MCB_COMMANDS == command) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "MCB command %u is not in the queue table", msg_id);
+        log_error(log_array);
+        return false;
+    }
+
+    // A command that has not been sent yet just takes the newest parameters
+    MCBQueued_t* entry = nullptr;
+    for (uint8_t i = 0; i < mcb_queue_count; i++) {
+        if (mcb_queue[i].command == command && !mcb_queue[i].in_flight) {
+            entry = &mcb_queue[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (MCB_QUEUE_SIZE == mcb_queue_count && urgent) {
+            MCBQueueEvict(command);
+        }
+        if (MCB_QUEUE_SIZE == mcb_queue_count && urgent && 0 == mcb_cmd_table[command].num_params) {
+            // Everything is in flight, send it anyway without ACK tracking
+            mcbComm.TX_ASCII(msg_id);
+            mcb_cmd_stats[command].sent++;
+            snprintf(log_array, LOG_ARRAY_SIZE, "MCB command queue full, %s sent untracked", mcb_cmd_table[command].name);
+            log_error(log_array);
+            return true;
+        }
+        if (MCB_QUEUE_SIZE == mcb_queue_count) {
+            mcb_cmd_stats[command].failures++;
+            snprintf(log_array, LOG_ARRAY_SIZE, "MCB command queue full, %s dropped", mcb_cmd_table[command].name);
+            log_error(log_array);
+            return false;
+        }
+        uint8_t index = mcb_queue_count;
+        if (urgent) {
+            // Urgent commands go ahead of everything that is still waiting to be sent
+            index = 0;
+            while (index < mcb_queue_count && mcb_queue[index].in_flight) {
+                index++;
+            }
+            memmove(&mcb_queue[index + 1], &mcb_queue[index], (mcb_queue_count - index) * sizeof(MCBQueued_t));
+        }
+        mcb_queue_count++;
+        entry = &mcb_queue[index];
+        entry->command = command;
+        entry->in_flight = false;
+        entry->tries = 0;
+    }
+    entry->params[0] = param0;
+    entry->params[1] = param1;
+    entry->urgent = urgent;
+
+    // Send right away if there is room in flight
+    MCBQueueService();
+    return true;
+}
+
+void StratoRATS::MCBQueueService()
+{
+    uint32_t now_ms = millis();
+    uint8_t in_flight = 0;
+
+    // Retry or drop the commands whose ACK is overdue
+    for (uint8_t i = 0; i < mcb_queue_count; i++) {
+        MCBQueued_t& entry = mcb_queue[i];
+        if (!entry.in_flight) {
+            continue;
+        }
+        const MCBCommandEntry_t& cmd = mcb_cmd_table[entry.command];
+        uint32_t timeout_ms = cmd.retry ? (MCB_ACK_TIMEOUT_MS << (entry.tries - 1)) : MCB_NO_RETRY_HOLD_MS;
+        if (now_ms - entry.sent_ms < timeout_ms) {
+            in_flight++;
+            continue;
+        }
+        if (!cmd.retry) {
+            mcb_cmd_stats[entry.command].failures++;
+            snprintf(log_array, LOG_ARRAY_SIZE, "MCB never ACKed %s, not resent", cmd.name);
+            log_error(log_array);
+            MCBQueueRemove(i--);
+            continue;
+        }
+        if (entry.tries > MCB_MAX_RETRIES) {
+            mcb_cmd_stats[entry.command].failures++;
+            snprintf(log_array, LOG_ARRAY_SIZE, "MCB never ACKed %s after %u tries", cmd.name, entry.tries);
+            ZephyrLogWarn(log_array);
+            log_error(log_array);
+            MCBQueueRemove(i--);
+            continue;
+        }
+        mcb_cmd_stats[entry.command].retries++;
+        MCBQueueTX(entry);
+        in_flight++;
+    }
+
+    // Send waiting commands, in order, while there is room
+    for (uint8_t i = 0; i < mcb_queue_count; i++) {
+        MCBQueued_t& entry = mcb_queue[i];
+        if (entry.in_flight) {
+            continue;
+        }
+        if (in_flight >= MCB_MAX_IN_FLIGHT && !entry.urgent) {
+            break;
+        }
+        // Wait for the ACK of an earlier command with the same id
+        bool busy = false;
+        for (uint8_t j = 0; j < i; j++) {
+            if (mcb_queue[j].in_flight && mcb_queue[j].command == entry.command) {
+                busy = true;
+                break;
+            }
+        }
+        if (busy) {
+            continue;
+        }
+        mcb_cmd_stats[entry.command].sent++;
+        MCBQueueTX(entry);
+        in_flight++;
+    }
+}
+
+void StratoRATS::MCBQueueAck(uint8_t msg_id)
+{
+    for (uint8_t i = 0; i < mcb_queue_count; i++) {
+        MCBQueued_t& entry = mcb_queue[i];
+        if (entry.in_flight && mcb_cmd_table[entry.command].msg_id == msg_id) {
+            MCBCommandStats_t& stats = mcb_cmd_stats[entry.command];
+            uint32_t rtt = micros() - entry.sent_us;
+            stats.acked++;
+            stats.total_us += rtt;
+            if (rtt > stats.max_us) {
+                stats.max_us = rtt;
+            }
+            MCBQueueRemove(i);
+            // The freed slot may let the next command go
+            MCBQueueService();
+            return;
+        }
+    }
+}
+
+void StratoRATS::MCBQueueTX(MCBQueued_t& entry)
+{
+    uint8_t msg_id = mcb_cmd_table[entry.command].msg_id;
+    bool success;
+
+    switch (msg_id) {
+    case MCB_REEL_IN:
+        success = mcbComm.TX_Reel_In(entry.params[0], entry.params[1]);
+        break;
+    case MCB_REEL_OUT:
+        success = mcbComm.TX_Reel_Out(entry.params[0], entry.params[1]);
+        break;
+    case MCB_IN_NO_LW:
+        success = mcbComm.TX_In_No_LW(entry.params[0], entry.params[1]);
+        break;
+    case MCB_IN_ACC:
+        success = mcbComm.TX_In_Acc(entry.params[0]);
+        break;
+    case MCB_OUT_ACC:
+        success = mcbComm.TX_Out_Acc(entry.params[0]);
+        break;
+    case MCB_TORQUE_LIMITS:
+        success = mcbComm.TX_Torque_Limits(entry.params[0], entry.params[1]);
+        break;
+    case MCB_CURR_LIMITS:
+        success = mcbComm.TX_Curr_Limits(entry.params[0], entry.params[1]);
+        break;
+    default:
+        mcbComm.TX_ASCII(msg_id);
+        success = true;
+        break;
+    }
+
+    if (!success) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "Error sending %s to MCB", mcb_cmd_table[entry.command].name);
+        log_error(log_array);
+    }
+
+    // A failed send is handled like a lost ACK
+    entry.in_flight = true;
+    entry.tries++;
+    entry.sent_ms = millis();
+    entry.sent_us = micros();
+}
+
+void StratoRATS::MCBQueueEvict(uint8_t command)
+{
+    // The newest command that has not been sent, and is not urgent itself
+    for (uint8_t i = mcb_queue_count; i-- > 0;) {
+        MCBQueued_t& entry = mcb_queue[i];
+        if (!entry.in_flight && !entry.urgent) {
+            mcb_cmd_stats[entry.command].failures++;
+            snprintf(log_array, LOG_ARRAY_SIZE, "MCB command queue full, %s dropped for %s",
+                mcb_cmd_table[entry.command].name, mcb_cmd_table[command].name);
+            log_error(log_array);
+            MCBQueueRemove(i);
+            return;
+        }
+    }
+}
+
+void StratoRATS::MCBQueueRemove(uint8_t index)
+{
+    memmove(&mcb_queue[index], &mcb_queue[index + 1], (mcb_queue_count - index - 1) * sizeof(MCBQueued_t));
+    mcb_queue_count--;
+}
@@ -11,6 +11,8 @@
 
 void StratoRATS::RunMCBRouter()
 {
+    mcb_serial_stats.Sample(MCB_SERIAL);
+
     SerialMessage_t rx_msg = mcbComm.RX();
 
     while (NO_MESSAGE != rx_msg) {
@@ -38,18 +40,18 @@ void StratoRATS::HandleMCBASCII()
         if (mcbComm.RX_Voltages(mcb_voltages, mcb_voltages+1, mcb_voltages+2, mcb_voltages+3)) {
             snprintf(log_array, LOG_ARRAY_SIZE, "MCB voltages: %.1f,%.1f,%.1f,%.1f", mcb_voltages[0], mcb_voltages[1],
                      mcb_voltages[2], mcb_voltages[3]);
-            SendMCBTM(FINE, log_array);
+            SendMCBStatusTM(FINE, log_array);
         } else {
-            SendMCBTM(CRIT, "Error receiving MCB voltages");
+            SendMCBStatusTM(CRIT, "Error receiving MCB voltages");
         }
         break;
     case MCB_MOTION_FINISHED:
-        CheckAction(ACTION_MOTION_TIMEOUT); // clear the timeout
+        CancelAction(ACTION_MOTION_TIMEOUT); // clear the timeout, even if it has fired
         log_nominal("MCB motion finished"); // state machine will report to Zephyr
         mcb_motion_ongoing = false;
         break;
     case MCB_MOTION_FAULT:
-        CheckAction(ACTION_MOTION_TIMEOUT); // clear the timeout
+        CancelAction(ACTION_MOTION_TIMEOUT); // clear the timeout, even if it has fired
         // if flag already cleared, assume this is the repeat
         if (!mcb_motion_ongoing) {
             return;
@@ -84,6 +86,8 @@ void StratoRATS::HandleMCBASCII()
 
 void StratoRATS::HandleMCBAck()
 {
+    MCBQueueAck(mcbComm.ack_id);
+
     switch (mcbComm.ack_id) {
     case MCB_CANCEL_MOTION:
         log_nominal("MCB acked cancel motion");
@@ -142,28 +146,35 @@ void StratoRATS::HandleMCBAck()
     case MCB_GET_VOLTAGES:
         ZephyrLogFine("MCB acked get MCB voltages");
         break;
+    case MCB_CONTROLLERS_ON:
+        ZephyrLogFine("MCB acked controllers on");
+        break;
+    case MCB_CONTROLLERS_OFF:
+        ZephyrLogFine("MCB acked controllers off");
+        break;
     default:
-        log_error(String(String("Unexpected MCB ACK received:")+String(mcbComm.ack_id)).c_str());
+        snprintf(log_array, LOG_ARRAY_SIZE, "Unexpected MCB ACK received:%u", (unsigned)mcbComm.ack_id);
+        log_error(log_array);
         break;
     }
 }
 
 void StratoRATS::HandleMCBBin()
 {
-    // reel_pos_index is the location in the binary data sent from the MCB. 
-    // That buffer is filled in MonitorMCB::SendMotionData(void),
-    // look in that code to determine the offset.
-    uint16_t reel_pos_index = 21; // todo: don't hard-code this
-
     switch (mcbComm.binary_rx.bin_id) {
     case MCB_MOTION_TM:
+    {
+        mcb_motion_seen = true;
+        uint16_t reel_pos_index = MCB_MOTION_REEL_POS_OFFSET;
         if (BufferGetFloat(&reel_pos, mcbComm.binary_rx.bin_buffer, mcbComm.binary_rx.bin_length, &reel_pos_index)) {
-            log_nominal((String("Reel pos: ") + String(reel_pos)).c_str());
+            RATS_LOG(MCB, RLOG_NOMINAL, RLOG_REEL_POS, reel_pos);
+            MotionHealthCheck();
         } else {
-            log_nominal("Received MCB bin: unable to read position");
+            RATS_LOG(MCB, RLOG_NOMINAL, RLOG_REEL_POS_UNKNOWN);
         }
         AddMCBTM();
         break;
+    }
     case MCB_EEPROM:
         SendMCBEEPROM();
         break;
@@ -182,7 +193,8 @@ void StratoRATS::HandleMCBString()
             inst_substate = MODE_ERROR;
             log_error("Entering FL_ERROR HandleMCBString()");
 #else
-            log_error((String("DISABLE_DEVEL_ERROR_CHECKING is enabled, MCB error will be ignored: ")+log_array).c_str());  
+            log_error("DISABLE_DEVEL_ERROR_CHECKING is enabled, MCB error will be ignored:");
+            log_error(log_array);
 #endif
         }
         break;
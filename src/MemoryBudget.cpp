@@ -0,0 +1,68 @@
+#include "StratoRATS.h"
+
+// RAM budget per subsystem. RAM1 (DTCM) holds the StratoRATS object and the
+// stack, RAM2 (OCRAM) holds the DMAMEM buffers and the heap. The budgets are
+// checked at build time; MemoryReport() logs the map and the free space at
+// startup, to size larger reports and SD caching. teensy_size prints the
+// totals for each region after the build.
+
+// The StratoRATS object, including StratoCore
+#define RATS_RAM1_BUDGET    (128 * 1024)
+// DMAMEM buffers: the arena, and the serial buffers in StratoCore_RATS.ino
+#define RATS_RAM2_BUDGET    (192 * 1024)
+
+#ifndef LOG_ZEPHYR_COMMS_SHARED
+#define ZEPHYR_SERIAL_RAM   (2 * ZEPHYR_SERIAL_BUFFER_SIZE)
+#else
+#define ZEPHYR_SERIAL_RAM   0
+#endif
+#define MCB_SERIAL_RAM      (2 * MCB_SERIAL_BUFFER_SIZE)
+#define RATS_RAM2_BYTES     (RATS_ARENA_SIZE + ZEPHYR_SERIAL_RAM + MCB_SERIAL_RAM)
+
+static_assert(sizeof(StratoRATS) <= RATS_RAM1_BUDGET, "StratoRATS exceeds RATS_RAM1_BUDGET");
+static_assert(RATS_RAM2_BYTES <= RATS_RAM2_BUDGET, "RAM2 buffers exceed RATS_RAM2_BUDGET");
+
+// Teensy 4.1 linker symbols
+extern unsigned long _ebss;
+extern unsigned long _estack;
+extern unsigned long _heap_end;
+extern "C" char* __brkval;
+
+struct MemoryBudgetEntry_t {
+    const char* name;
+    uint32_t bytes;
+    uint8_t region;
+};
+
+void StratoRATS::MemoryReport()
+{
+    const MemoryBudgetEntry_t budget[] = {
+        {"RATS reports",        sizeof(rats_reports),       1},
+        {"MCB binary RX",       sizeof(binary_mcb),         1},
+        {"MCB command queue",   sizeof(mcb_queue),          1},
+        {"LoRa RX queue",       sizeof(lora_rx_queue),      1},
+        {"Deferred log",        sizeof(rats_log),           1},
+        {"Config store",        sizeof(ratsConfigs),        1},
+        {"Scheduler",           sizeof(rats_scheduler),     1},
+        {"Loop profiler",       sizeof(loop_profiler),      1},
+        {"StratoRATS total",    sizeof(StratoRATS),         1},
+        {"Arena (MCB TM/replay)", RATS_ARENA_SIZE,          2},
+        {"Zephyr serial",       ZEPHYR_SERIAL_RAM,          2},
+        {"MCB serial",          MCB_SERIAL_RAM,             2},
+    };
+
+    for (const MemoryBudgetEntry_t& entry : budget) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "RAM%u %-22s %6lu bytes", entry.region, entry.name, entry.bytes);
+        log_nominal(log_array);
+    }
+
+    char stack;
+    uint32_t ram1_free = (uint32_t)(&stack - (char*)&_ebss);
+    uint32_t ram2_free = (uint32_t)((char*)&_heap_end - __brkval);
+    snprintf(log_array, LOG_ARRAY_SIZE, "RAM1 %lu of %u bytes budgeted, %lu free to the stack",
+        (uint32_t)sizeof(StratoRATS), RATS_RAM1_BUDGET, ram1_free);
+    log_nominal(log_array);
+    snprintf(log_array, LOG_ARRAY_SIZE, "RAM2 %u of %u bytes budgeted, %lu free to the heap",
+        (unsigned)RATS_RAM2_BYTES, RATS_RAM2_BUDGET, ram2_free);
+    log_nominal(log_array);
+}
@@ -0,0 +1,88 @@
+#include <stdarg.h>
+#include "StratoRATS.h"
+
+// Streaming reel motion health monitor. Each MCB_MOTION_TM record is checked
+// against the commanded motion in motion_config:
+//  - stall: the reel moved less than MOTION_STALL_MIN_REVS, or no motion TM
+//    arrived, for ratsConfigs.motion_stall_secs
+//  - overspeed: the reel rate over a MOTION_HEALTH_WINDOW_MS window exceeded
+//    ratsConfigs.motion_overspeed times the commanded velocity
+// The checks start MOTION_HEALTH_GRACE_MS after the motion starts, to allow for
+// the acceleration. A fault sets ACTION_MOTION_HEALTH, and Flight_Reel() cancels
+// the motion.
+// The monitor is off by default (ratsConfigs.motion_monitor), since the
+// thresholds have not been tuned on flight data yet.
+
+void StratoRATS::MotionHealthStart()
+{
+    motion_health.enabled = ratsConfigs.motion_monitor.Read();
+    motion_health.stall_ms = 1000UL * ratsConfigs.motion_stall_secs.Read();
+    motion_health.overspeed = ratsConfigs.motion_overspeed.Read();
+    motion_health.records = 0;
+    motion_health.last_tm_ms = millis();
+    motion_health.fault = false;
+    motion_health.max_rate = 0.0f;
+    motion_health.msg[0] = '\0';
+}
+
+void StratoRATS::MotionHealthCheck()
+{
+    if (!motion_health.enabled || motion_health.fault || !mcb_motion_ongoing) {
+        return;
+    }
+
+    uint32_t now_ms = millis();
+    motion_health.last_tm_ms = now_ms;
+    motion_health.records++;
+
+    // Restart the windows in the grace period, so they start from a moving reel
+    if (now_ms - reel_motion_start < MOTION_HEALTH_GRACE_MS) {
+        motion_health.stall_pos = reel_pos;
+        motion_health.stall_ms_start = now_ms;
+        motion_health.window_pos = reel_pos;
+        motion_health.window_ms_start = now_ms;
+        return;
+    }
+
+    if (fabsf(reel_pos - motion_health.stall_pos) >= MOTION_STALL_MIN_REVS) {
+        motion_health.stall_pos = reel_pos;
+        motion_health.stall_ms_start = now_ms;
+    } else if (now_ms - motion_health.stall_ms_start >= motion_health.stall_ms) {
+        MotionHealthFault("Reel stalled at %.2f revs for %lu s", reel_pos,
+            (now_ms - motion_health.stall_ms_start) / 1000);
+        return;
+    }
+
+    uint32_t window_ms = now_ms - motion_health.window_ms_start;
+    if (window_ms >= MOTION_HEALTH_WINDOW_MS) {
+        float rate = 60000.0f * fabsf(reel_pos - motion_health.window_pos) / window_ms;
+        motion_health.max_rate = max(motion_health.max_rate, rate);
+        if (rate > motion_health.overspeed * motion_config.velocity) {
+            MotionHealthFault("Reel overspeed %.1f revs/min, commanded %.1f", rate, motion_config.velocity);
+            return;
+        }
+        motion_health.window_pos = reel_pos;
+        motion_health.window_ms_start = now_ms;
+    }
+}
+
+void StratoRATS::MotionHealthWatchdog()
+{
+    // A motion that stops sending TM is a stall too, once TM has started to arrive
+    if (motion_health.enabled && !motion_health.fault && mcb_motion_ongoing && motion_health.records
+        && millis() - motion_health.last_tm_ms >= motion_health.stall_ms) {
+        MotionHealthFault("No MCB motion TM for %lu s", (millis() - motion_health.last_tm_ms) / 1000);
+    }
+}
+
+void StratoRATS::MotionHealthFault(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vsnprintf(motion_health.msg, sizeof(motion_health.msg), format, args);
+    va_end(args);
+
+    motion_health.fault = true;
+    motion_health.faults++;
+    SetAction(ACTION_MOTION_HEALTH);
+}
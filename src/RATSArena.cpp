@@ -0,0 +1,31 @@
+/*
+ *  RATSArena.cpp
+ *
+ *  Shared buffer, see RATSArena.h
+ */
+
+#include "RATSArena.h"
+
+uint8_t* RATSArena::Acquire(ArenaUser_t user, uint32_t bytes)
+{
+    if (bytes > size) {
+        return nullptr;
+    }
+    if (owner != ARENA_FREE && owner != user) {
+        conflicts++;
+        return nullptr;
+    }
+
+    owner = user;
+    if (bytes > high_water) {
+        high_water = bytes;
+    }
+    return data;
+}
+
+void RATSArena::Release(ArenaUser_t user)
+{
+    if (owner == user) {
+        owner = ARENA_FREE;
+    }
+}
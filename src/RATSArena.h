@@ -0,0 +1,48 @@
+/*
+ *  RATSArena.h
+ *
+ *  One buffer shared by the subsystems that never need their large buffers
+ *  at the same time. A user acquires the whole arena, and it stays with that
+ *  user until it is released. A request from another user while the arena is
+ *  held fails and is counted, and the caller tries again later.
+ */
+
+#ifndef RATSARENA_H
+#define RATSARENA_H
+
+#include <Arduino.h>
+
+enum ArenaUser_t : uint8_t {
+    ARENA_FREE,
+    // MCB motion TM collection, from the motion start to the last chunk
+    ARENA_MCB_TM,
+    // A RATSREPLAY record, while it is read back and sent
+    ARENA_DATALOG_REPLAY,
+    NUM_ARENA_USERS
+};
+
+class RATSArena {
+public:
+    RATSArena(uint8_t* buffer, uint32_t buffer_size) : data(buffer), size(buffer_size) { }
+
+    // Acquire bytes for user. Returns nullptr if another user holds the arena,
+    // or if bytes is larger than the arena. Acquiring it again is allowed.
+    uint8_t* Acquire(ArenaUser_t user, uint32_t bytes);
+    // Release the arena, if it is held by user
+    void Release(ArenaUser_t user);
+
+    ArenaUser_t Owner() const { return owner; }
+    uint8_t* Data() const { return data; }
+    uint32_t Size() const { return size; }
+    // Requests that failed because the arena was held by another user
+    uint32_t conflicts = 0;
+    // The largest size acquired
+    uint32_t high_water = 0;
+
+private:
+    uint8_t* const data;
+    const uint32_t size;
+    ArenaUser_t owner = ARENA_FREE;
+};
+
+#endif /* RATSARENA_H */
@@ -0,0 +1,240 @@
+/*
+ *  RATSConfigStore.cpp
+ *
+ *  RAM-cached, write-coalescing config store, see RATSConfigStore.h
+ */
+
+#include "RATSConfigStore.h"
+#include "StratoGroundPort.h"
+#include <EEPROM.h>
+
+void ConfigDataBase::MarkDirty()
+{
+    if (!store) {
+        return;
+    }
+    store->dirty = true;
+    store->image_stale = true;
+    store->dirty_millis = millis();
+}
+
+bool RATSConfigStore::Register(ConfigDataBase* item, uint8_t id)
+{
+    if (num_items == CONFIG_MAX_ITEMS) {
+        return false;
+    }
+    for (uint8_t i = 0; i < num_items; i++) {
+        if (items[i]->id == id) {
+            return false;
+        }
+    }
+    item->id = id;
+    item->store = this;
+    items[num_items++] = item;
+    return true;
+}
+
+bool RATSConfigStore::Initialize()
+{
+    num_items = 0;
+    RegisterAll();
+
+    ConfigBankHeader_t header[2];
+    bool valid[2] = {ReadBank(0, header[0]), ReadBank(1, header[1])};
+
+    if (!valid[0] && !valid[1]) {
+        loaded = 0;
+        defaulted = num_items;
+        active_bank = 1; // so that the first commit goes to bank 0
+        dirty = true;
+        image_stale = true;
+        Commit();
+        return false;
+    }
+
+    if (valid[0] && valid[1]) {
+        active_bank = ((int32_t)(header[1].sequence - header[0].sequence) > 0) ? 1 : 0;
+    } else {
+        active_bank = valid[0] ? 0 : 1;
+    }
+    sequence = header[active_bank].sequence;
+
+    uint16_t length = header[active_bank].length;
+    for (uint16_t i = 0; i < length; i++) {
+        image[i] = EEPROM.read(base_address + active_bank * CONFIG_BANK_SIZE + sizeof(ConfigBankHeader_t) + i);
+    }
+    Deserialize(image, length);
+
+    // Rewrite the bank if the layout has changed, so that new configs are stored
+    image_stale = true;
+    dirty = (defaulted > 0) || (header[active_bank].version != version);
+    if (dirty) {
+        Commit();
+    }
+
+    return true;
+}
+
+void RATSConfigStore::Service()
+{
+    uint32_t delay_ms = retry_ms ? retry_ms : CONFIG_COMMIT_DELAY_MS;
+    if (dirty && (millis() - dirty_millis >= delay_ms)) {
+        Commit();
+    }
+}
+
+bool RATSConfigStore::Commit()
+{
+    if (!dirty) {
+        return true;
+    }
+
+    Serialize();
+
+    ConfigBankHeader_t header;
+    header.magic = CONFIG_STORE_MAGIC;
+    header.version = version;
+    header.sequence = sequence + 1;
+    header.length = image_length;
+    header.crc = CRC16(image, image_length);
+
+    // Write the records, then the header, into the older bank
+    uint8_t bank = active_bank ^ 1;
+    uint16_t address = base_address + bank * CONFIG_BANK_SIZE;
+    for (uint16_t i = 0; i < image_length; i++) {
+        EEPROM.update(address + sizeof(ConfigBankHeader_t) + i, image[i]);
+    }
+    const uint8_t* header_bytes = (const uint8_t*)&header;
+    for (uint16_t i = 0; i < sizeof(header); i++) {
+        EEPROM.update(address + i, header_bytes[i]);
+    }
+
+    ConfigBankHeader_t check;
+    if (!ReadBank(bank, check) || check.sequence != header.sequence) {
+        commit_errors++;
+        // Back off, rather than rewriting a failing EEPROM on every call
+        retry_ms = retry_ms ? min(2 * retry_ms, (uint32_t)CONFIG_RETRY_MAX_MS) : CONFIG_RETRY_MIN_MS;
+        dirty_millis = millis();
+        return false;
+    }
+
+    sequence = header.sequence;
+    active_bank = bank;
+    dirty = false;
+    retry_ms = 0;
+    commits++;
+    return true;
+}
+
+uint16_t RATSConfigStore::Bufferize(uint8_t* buffer, uint16_t max_length)
+{
+    Serialize();
+
+    if (sizeof(ConfigBankHeader_t) + image_length > max_length) {
+        return 0;
+    }
+
+    ConfigBankHeader_t header;
+    header.magic = CONFIG_STORE_MAGIC;
+    header.version = version;
+    header.sequence = sequence;
+    header.length = image_length;
+    header.crc = CRC16(image, image_length);
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), image, image_length);
+
+    return sizeof(header) + image_length;
+}
+
+void RATSConfigStore::Serialize()
+{
+    if (!image_stale) {
+        return;
+    }
+
+    image_length = 0;
+    for (uint8_t i = 0; i < num_items; i++) {
+        const ConfigDataBase* item = items[i];
+        if (image_length + 2 + item->size > CONFIG_IMAGE_MAX) {
+            // RATSConfigs.cpp checks this at build time, so it should not happen
+            char msg[64];
+            snprintf(msg, sizeof(msg), "Configs from id %u on do not fit in the EEPROM bank", item->id);
+            log_error(msg);
+            break;
+        }
+        image[image_length++] = item->id;
+        image[image_length++] = item->size;
+        memcpy(image + image_length, item->value, item->size);
+        image_length += item->size;
+    }
+    image_stale = false;
+}
+
+bool RATSConfigStore::ReadBank(uint8_t bank, ConfigBankHeader_t& header)
+{
+    uint16_t address = base_address + bank * CONFIG_BANK_SIZE;
+    EEPROM.get(address, header);
+
+    if (header.magic != CONFIG_STORE_MAGIC || header.length > CONFIG_IMAGE_MAX) {
+        return false;
+    }
+
+    // CRC the records straight from the EEPROM, so the image is not disturbed
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < header.length; i++) {
+        crc = CRC16Update(crc, EEPROM.read(address + sizeof(ConfigBankHeader_t) + i));
+    }
+
+    return crc == header.crc;
+}
+
+void RATSConfigStore::Deserialize(const uint8_t* records, uint16_t length)
+{
+    // A duplicated record loads the same config twice, so count per config
+    bool found[CONFIG_MAX_ITEMS] = {false};
+    uint16_t i = 0;
+
+    while (i + 2 <= length) {
+        uint8_t id = records[i];
+        uint8_t size = records[i + 1];
+        if (i + 2 + size > length) {
+            break;
+        }
+        for (uint8_t j = 0; j < num_items; j++) {
+            if (items[j]->id == id && items[j]->size == size) {
+                memcpy(items[j]->value, records + i + 2, size);
+                found[j] = true;
+                break;
+            }
+        }
+        i += 2 + size;
+    }
+
+    loaded = 0;
+    defaulted = 0;
+    for (uint8_t j = 0; j < num_items; j++) {
+        if (found[j]) {
+            loaded++;
+        } else {
+            defaulted++;
+        }
+    }
+}
+
+uint16_t RATSConfigStore::CRC16Update(uint16_t crc, uint8_t b)
+{
+    crc ^= (uint16_t)b << 8;
+    for (uint8_t j = 0; j < 8; j++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+uint16_t RATSConfigStore::CRC16(const uint8_t* data, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) {
+        crc = CRC16Update(crc, data[i]);
+    }
+    return crc;
+}
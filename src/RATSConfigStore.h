@@ -0,0 +1,133 @@
+/*
+ *  RATSConfigStore.h
+ *
+ *  RAM-cached configuration store in the Teensy EEPROM. Each ConfigData<T>
+ *  holds its value in RAM; Read() never touches the EEPROM, and Write() only
+ *  updates RAM and marks the store dirty. Service() commits all of the dirty
+ *  values in one transaction once no write has happened for
+ *  CONFIG_COMMIT_DELAY_MS, so a burst of TCs costs a single commit. A commit
+ *  that fails to verify is retried after CONFIG_RETRY_MIN_MS, doubling up to
+ *  CONFIG_RETRY_MAX_MS, until one succeeds.
+ *
+ *  A commit serializes every config as an (id, size, value) record into the
+ *  image, and writes it to the older of two banks behind a header with a
+ *  sequence number and CRC. Loading picks the newest valid bank, so a reset
+ *  during a commit falls back to the previous one. Alternating banks, and
+ *  EEPROM.update() only rewriting changed bytes, keep the EEPROM wear down.
+ *
+ *  Configs are matched by id when loading, not by position: a config added in
+ *  a later version keeps its default, and a removed or resized one is ignored.
+ *  Never reuse or renumber an id.
+ */
+
+#ifndef RATSCONFIGSTORE_H
+#define RATSCONFIGSTORE_H
+
+#include <Arduino.h>
+
+#define CONFIG_MAX_ITEMS        32
+#define CONFIG_BANK_SIZE        512
+#define CONFIG_STORE_MAGIC      0x5243
+#define CONFIG_COMMIT_DELAY_MS  1000
+#define CONFIG_RETRY_MIN_MS     10000
+#define CONFIG_RETRY_MAX_MS     600000
+
+// In front of the records of a bank, and of the Bufferize() output
+struct ConfigBankHeader_t {
+    uint16_t magic;
+    uint16_t version;
+    uint32_t sequence;
+    uint16_t length;    // record bytes that follow the header
+    uint16_t crc;       // CRC-16/CCITT of the records
+};
+
+#define CONFIG_IMAGE_MAX (CONFIG_BANK_SIZE - sizeof(ConfigBankHeader_t))
+
+class RATSConfigStore;
+
+class ConfigDataBase {
+    friend class RATSConfigStore;
+protected:
+    ConfigDataBase(void* value, uint8_t size) : value(value), size(size) { }
+    void MarkDirty();
+private:
+    void* value;
+    uint8_t size;
+    uint8_t id = 0;
+    RATSConfigStore* store = nullptr;
+};
+
+template <typename T>
+class ConfigData : public ConfigDataBase {
+    static_assert(sizeof(T) <= 255, "ConfigData value too large");
+public:
+    ConfigData(T default_value) : ConfigDataBase(&data, sizeof(T)), data(default_value) { }
+    T Read() const { return data; }
+    // Update the RAM copy; the EEPROM is written by RATSConfigStore::Service()
+    bool Write(T new_value) {
+        if (memcmp(&data, &new_value, sizeof(T))) {
+            data = new_value;
+            MarkDirty();
+        }
+        return true;
+    }
+private:
+    T data;
+};
+
+class RATSConfigStore {
+    friend class ConfigDataBase;
+public:
+    RATSConfigStore(uint16_t version, uint16_t base_address)
+        : version(version), base_address(base_address) { }
+
+    // Register the configs and load them from the newest valid bank. Returns false
+    // if no bank was valid, in which case the defaults are used and committed.
+    bool Initialize();
+    // Commit the dirty configs once the writes have settled. Call from the loop.
+    void Service();
+    // Commit the dirty configs now. Returns false if the commit did not verify.
+    bool Commit();
+    // Copy the header and records of the current values into buffer. Returns the length, 0 on error.
+    uint16_t Bufferize(uint8_t* buffer, uint16_t max_length);
+
+    bool Dirty() const { return dirty; }
+    // True from a failed commit until the next one that succeeds
+    bool Failing() const { return retry_ms != 0; }
+    uint32_t commits = 0;
+    uint32_t commit_errors = 0;
+    // Configs loaded from the EEPROM and configs left at their defaults by the last Initialize()
+    uint8_t loaded = 0;
+    uint8_t defaulted = 0;
+
+protected:
+    virtual void RegisterAll() = 0;
+    // Register a config under its permanent id
+    bool Register(ConfigDataBase* item, uint8_t id);
+
+private:
+    void Serialize();
+    bool ReadBank(uint8_t bank, ConfigBankHeader_t& header);
+    void Deserialize(const uint8_t* records, uint16_t length);
+    static uint16_t CRC16Update(uint16_t crc, uint8_t b);
+    static uint16_t CRC16(const uint8_t* data, uint16_t length);
+
+    uint16_t version;
+    uint16_t base_address;
+    ConfigDataBase* items[CONFIG_MAX_ITEMS];
+    uint8_t num_items = 0;
+
+    // The serialized records of the current values, valid while !image_stale
+    uint8_t image[CONFIG_IMAGE_MAX];
+    uint16_t image_length = 0;
+    bool image_stale = true;
+
+    bool dirty = false;
+    uint32_t dirty_millis = 0;
+    // The delay before the next retry after a failed commit, 0 if the last one succeeded
+    uint32_t retry_ms = 0;
+    uint32_t sequence = 0;
+    uint8_t active_bank = 0;
+};
+
+#endif /* RATSCONFIGSTORE_H */
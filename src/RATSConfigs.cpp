@@ -6,7 +6,7 @@
 #include "StratoGroundPort.h"
 
 RATSConfigs::RATSConfigs()
-    : TeensyEEPROM(CONFIG_VERSION, BASE_ADDRESS),
+    : RATSConfigStore(CONFIG_VERSION, BASE_ADDRESS),
     // ------------ Hard-Coded Config Defaults ------------
     // TODO Assign correct default values here
     data_proc_method(1),
@@ -14,26 +14,77 @@ RATSConfigs::RATSConfigs()
     deploy_velocity(10.0f),
     retract_velocity(10.0f),
     motion_timeout(10),
-    real_time_mcb(false)
+    real_time_mcb(false),
+    mcb_decimation(1),
+    report_records(180),
+    report_period(300),
+    report_adaptive(false),
+    warmup_msgs(3),
+    warmup_min_rssi(-150),
+    warmup_min_snr(-20.0f),
+    reel_overlap(false),
+    profile(ProfileTable_t{}),
+    motion_monitor(false),
+    motion_stall_secs(20),
+    motion_overspeed(1.5f),
+    duty_cycle(false),
+    duty_on_secs(900),
+    duty_off_secs(1800),
+    duty_records(0),
+    lora_adaptive(false)
 
     // ----------------------------------------------------
 { }
 
+// The (id, size) record header and value of a config in the bank image
+#define CONFIG_RECORD_BYTES(config) (2 + sizeof(((RATSConfigs*)nullptr)->config.Read()))
+
+// Every config registered below must fit in one bank
+static_assert(CONFIG_RECORD_BYTES(data_proc_method) + CONFIG_RECORD_BYTES(ecu_tempC)
+    + CONFIG_RECORD_BYTES(deploy_velocity) + CONFIG_RECORD_BYTES(retract_velocity)
+    + CONFIG_RECORD_BYTES(motion_timeout) + CONFIG_RECORD_BYTES(real_time_mcb)
+    + CONFIG_RECORD_BYTES(mcb_decimation) + CONFIG_RECORD_BYTES(report_records)
+    + CONFIG_RECORD_BYTES(report_period) + CONFIG_RECORD_BYTES(report_adaptive)
+    + CONFIG_RECORD_BYTES(warmup_msgs) + CONFIG_RECORD_BYTES(warmup_min_rssi)
+    + CONFIG_RECORD_BYTES(warmup_min_snr) + CONFIG_RECORD_BYTES(reel_overlap)
+    + CONFIG_RECORD_BYTES(profile) + CONFIG_RECORD_BYTES(motion_monitor)
+    + CONFIG_RECORD_BYTES(motion_stall_secs) + CONFIG_RECORD_BYTES(motion_overspeed)
+    + CONFIG_RECORD_BYTES(duty_cycle) + CONFIG_RECORD_BYTES(duty_on_secs)
+    + CONFIG_RECORD_BYTES(duty_off_secs) + CONFIG_RECORD_BYTES(duty_records)
+    + CONFIG_RECORD_BYTES(lora_adaptive) <= CONFIG_IMAGE_MAX,
+    "The registered configs do not fit in a CONFIG_BANK_SIZE bank");
+
 void RATSConfigs::RegisterAll()
 {
     // Called from the base class Initialize method,
-    // this method registers all EEPROMData objects
-    // and thus determines the length of the bufferized data.
-    // The order of registration must match the order of
-    // the objects in the constructor and the EEPROM buffer.
+    // this method registers all ConfigData objects.
+    // The ids are stored with the values, and must never change.
 
     bool success = true;
 
-    success &= Register(&data_proc_method);
-    success &= Register(&deploy_velocity);
-    success &= Register(&retract_velocity);
-    success &= Register(&motion_timeout);
-    success &= Register(&real_time_mcb);
+    success &= Register(&data_proc_method, 1);
+    success &= Register(&ecu_tempC, 2);
+    success &= Register(&deploy_velocity, 3);
+    success &= Register(&retract_velocity, 4);
+    success &= Register(&motion_timeout, 5);
+    success &= Register(&real_time_mcb, 6);
+    success &= Register(&mcb_decimation, 7);
+    success &= Register(&report_records, 8);
+    success &= Register(&report_period, 9);
+    success &= Register(&report_adaptive, 10);
+    success &= Register(&warmup_msgs, 11);
+    success &= Register(&warmup_min_rssi, 12);
+    success &= Register(&warmup_min_snr, 13);
+    success &= Register(&reel_overlap, 14);
+    success &= Register(&profile, 15);
+    success &= Register(&motion_monitor, 16);
+    success &= Register(&motion_stall_secs, 17);
+    success &= Register(&motion_overspeed, 18);
+    success &= Register(&duty_cycle, 19);
+    success &= Register(&duty_on_secs, 20);
+    success &= Register(&duty_off_secs, 21);
+    success &= Register(&duty_records, 22);
+    success &= Register(&lora_adaptive, 23);
 
     if (!success) {
         debug_serial->println("Error registering EEPROM configs");
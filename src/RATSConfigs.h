@@ -6,37 +6,96 @@
  *  This class manages configuration storage in EEPROM on the PIB
  *
  *  To add a configuration value:
- *    1) Add a public EEPROMData<T> object in the header file
+ *    1) Add a public ConfigData<T> object in the header file
  *    2) Set the hard-coded backup value in the constructor
- *    3) Register the object in the RegisterAll method
- *    *note* maintain the order of objects in all three locations
+ *    3) Register the object with a new, unused id in the RegisterAll method,
+ *       and add it to the bank size check above RegisterAll
+ *    *note* configs are stored by id, so CONFIG_VERSION no longer needs a bump.
+ *    Never reuse the id of a removed config.
  */
 
 #ifndef RATSCONFIG_H
 #define RATSCONFIG_H
 
-#include "TeensyEEPROM.h"
+#include "RATSConfigStore.h"
 
-class RATSConfigs : public TeensyEEPROM {
+// Profile sequencer program (see Flight_Profile.cpp)
+#define RATS_PROFILE_MAX_LEGS   8
+#define PROFILE_LEG_OUT         0
+#define PROFILE_LEG_IN          1
+#define PROFILE_LEG_ECU_ON      0x01    // ProfileLeg_t flags
+
+struct ProfileLeg_t {
+    float length;           // revs
+    float velocity;         // revs/min, 0 for the configured velocity
+    uint16_t dwell_secs;    // wait after the motion, before the next leg
+    uint8_t direction;      // PROFILE_LEG_OUT or PROFILE_LEG_IN
+    uint8_t flags;          // PROFILE_LEG_ECU_ON keeps the ECU powered during the leg and dwell
+    uint8_t decimation;     // MCB TM decimation for the leg, 0 for ratsConfigs.mcb_decimation
+};
+
+struct ProfileTable_t {
+    uint8_t num_legs;
+    uint8_t leg_mask;       // bit n is set once leg n has been uploaded
+    ProfileLeg_t legs[RATS_PROFILE_MAX_LEGS];
+};
+
+static_assert(RATS_PROFILE_MAX_LEGS <= 8, "ProfileTable_t leg_mask is 8 bits");
+// The leg_mask of a program with all of its num_legs legs uploaded
+#define PROFILE_ALL_LEGS(num_legs) ((uint8_t)((1u << (num_legs)) - 1))
+
+class RATSConfigs : public RATSConfigStore {
 private:
-    void RegisterAll();
+    void RegisterAll() override;
 
 public:
     RATSConfigs();
 
-    // constants, manually change version number here to force update
-    static const uint16_t CONFIG_VERSION = 0x000B;
+    // constants, the version is recorded with the configs for reference
+    static const uint16_t CONFIG_VERSION = 0x0011;
     static const uint16_t BASE_ADDRESS = 0x0000;
 
     // ------------------ Configurations ------------------
-    EEPROMData<uint16_t> data_proc_method;
-    EEPROMData<float> ecu_tempC;
-    EEPROMData<float> deploy_velocity;   // revs/min
-    EEPROMData<float> retract_velocity;  // revs/min
-    EEPROMData<uint16_t> motion_timeout;
+    ConfigData<uint16_t> data_proc_method;
+    ConfigData<float> ecu_tempC;
+    ConfigData<float> deploy_velocity;   // revs/min
+    ConfigData<float> retract_velocity;  // revs/min
+    ConfigData<uint16_t> motion_timeout;
 
     // MCB TM mode
-    EEPROMData<bool> real_time_mcb;
+    ConfigData<bool> real_time_mcb;
+    ConfigData<uint8_t> mcb_decimation;      // keep every Nth motion record, 0 or 1 for all
+
+    // RATS report cadence
+    ConfigData<uint16_t> report_records;     // ECU records per report
+    ConfigData<uint16_t> report_period;      // seconds
+    ConfigData<bool> report_adaptive;        // adapt batch size to the TM link
+
+    // Warmup completion: ECU LoRa frames needed, and the minimum link quality for a frame to count
+    ConfigData<uint16_t> warmup_msgs;
+    ConfigData<int16_t> warmup_min_rssi;     // dBm
+    ConfigData<float> warmup_min_snr;        // dB
+
+    // Keep the ECU on and the RATS report running during reel motions
+    ConfigData<bool> reel_overlap;
+
+    // Profile sequencer program
+    ConfigData<ProfileTable_t> profile;
+
+    // Motion health monitor: stall time, and the overspeed limit as a multiple of the commanded velocity
+    ConfigData<bool> motion_monitor;
+    ConfigData<uint16_t> motion_stall_secs;
+    ConfigData<float> motion_overspeed;
+
+    // ECU measurement duty cycle in FL_MEASURE: maximum on-time and off-time per burst, and records
+    // per burst (0 for one RATS report)
+    ConfigData<bool> duty_cycle;
+    ConfigData<uint16_t> duty_on_secs;
+    ConfigData<uint16_t> duty_off_secs;
+    ConfigData<uint16_t> duty_records;
+
+    // Adapt the ECU LoRa rate and TX power to the link margin (LoRaLink.cpp)
+    ConfigData<bool> lora_adaptive;
 
 };
 
@@ -0,0 +1,114 @@
+/*
+ *  RATSDataLog.cpp
+ *
+ *  SD card log of TM payloads, see RATSDataLog.h
+ */
+
+#include "RATSDataLog.h"
+
+bool RATSDataLog::Begin()
+{
+    ready = false;
+    unflushed = 0;
+
+    // SD.begin() has been called by StratoCore::InitializeCore()
+    data_file = SD.open(DATALOG_DATA_FILE, FILE_WRITE);
+    index_file = SD.open(DATALOG_INDEX_FILE, FILE_WRITE);
+    if (!data_file || !index_file) {
+        return false;
+    }
+
+    // Drop a partial index entry left by a reset during an append
+    uint32_t entries = index_file.size() / sizeof(DataLogEntry_t);
+    if (index_file.size() != entries * sizeof(DataLogEntry_t)) {
+        index_file.truncate(entries * sizeof(DataLogEntry_t));
+    }
+
+    // Drop the index entries whose payload was lost in a reset before the flush
+    DataLogEntry_t entry;
+    uint32_t valid = entries;
+    while (valid > 0 && index_file.seek((valid - 1) * sizeof(DataLogEntry_t))
+        && index_file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry)
+        && entry.offset + entry.length > data_file.size()) {
+        valid--;
+    }
+    if (valid != entries) {
+        index_file.truncate(valid * sizeof(DataLogEntry_t));
+    }
+    next_seq = valid;
+    ready = true;
+
+    return true;
+}
+
+uint32_t RATSDataLog::Append(DataLogType_t type, uint32_t epoch, const uint8_t* data, uint16_t length)
+{
+    if (!ready) {
+        errors++;
+        return DATALOG_NO_SEQ;
+    }
+
+    DataLogEntry_t entry;
+    entry.seq = next_seq;
+    entry.epoch = epoch;
+    entry.offset = data_file.size();
+    entry.length = length;
+    entry.type = type;
+    entry.reserved = 0;
+
+    // The payload is written first, so an index entry never points at missing data
+    data_file.seek(entry.offset);
+    if (data_file.write(data, length) != length) {
+        errors++;
+        return DATALOG_NO_SEQ;
+    }
+
+    index_file.seek(next_seq * sizeof(DataLogEntry_t));
+    if (index_file.write((const uint8_t*)&entry, sizeof(entry)) != sizeof(entry)) {
+        errors++;
+        return DATALOG_NO_SEQ;
+    }
+
+    if (0 == unflushed++) {
+        unflushed_millis = millis();
+    }
+    if (unflushed >= DATALOG_FLUSH_RECORDS) {
+        Flush();
+    }
+
+    return next_seq++;
+}
+
+void RATSDataLog::Service()
+{
+    if (unflushed && millis() - unflushed_millis >= DATALOG_FLUSH_MS) {
+        Flush();
+    }
+}
+
+void RATSDataLog::Flush()
+{
+    // The payloads first, so that a flushed index entry has its data
+    data_file.flush();
+    index_file.flush();
+    unflushed = 0;
+}
+
+bool RATSDataLog::Read(uint32_t seq, DataLogEntry_t& entry, uint8_t* buffer, uint16_t size)
+{
+    if (!ready || seq >= next_seq) {
+        return false;
+    }
+
+    if (!index_file.seek(seq * sizeof(DataLogEntry_t))
+        || index_file.read((uint8_t*)&entry, sizeof(entry)) != sizeof(entry)
+        || entry.seq != seq || entry.length > size) {
+        return false;
+    }
+
+    if (!data_file.seek(entry.offset)) {
+        return false;
+    }
+
+    return data_file.read(buffer, entry.length) == entry.length;
+}
@@ -0,0 +1,79 @@
+/*
+ *  RATSDataLog.h
+ *
+ *  Append-only log of the RATS report and MCB motion TM payloads on the SD
+ *  card, so that lost TMs can be replayed on request. Payloads are appended
+ *  to DATALOG_DATA_FILE, and a fixed-size index entry (sequence number,
+ *  epoch, offset, length, type) is appended to DATALOG_INDEX_FILE. The
+ *  sequence number of a record is its position in the index, so a record is
+ *  found with a single seek. Both files survive resets; the next sequence
+ *  number continues from the size of the index.
+ *
+ *  The SD card is started by StratoCore::InitializeCore(), which also writes
+ *  its own TM files there. The files are flushed every DATALOG_FLUSH_RECORDS
+ *  appends, or by Service() DATALOG_FLUSH_MS after the first unflushed one,
+ *  so a reset can lose the last few records. Begin() drops index entries
+ *  whose payload did not make it to the card.
+ */
+
+#ifndef RATSDATALOG_H
+#define RATSDATALOG_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#define DATALOG_DATA_FILE   "RATSDATA.BIN"
+#define DATALOG_INDEX_FILE  "RATSDATA.IDX"
+
+// Returned by Append() when the record could not be logged
+#define DATALOG_NO_SEQ      0xFFFFFFFF
+// Flush after this many appends, or this long after the first unflushed append
+#define DATALOG_FLUSH_RECORDS   8
+#define DATALOG_FLUSH_MS        5000
+
+enum DataLogType_t : uint8_t {
+    DATALOG_RATS_REPORT = 1,
+    DATALOG_MCB_TM = 2,
+};
+
+struct DataLogEntry_t {
+    uint32_t seq;
+    uint32_t epoch;
+    uint32_t offset;
+    uint16_t length;
+    uint8_t type;
+    uint8_t reserved;
+};
+static_assert(sizeof(DataLogEntry_t) == 16, "DataLogEntry_t must be packed to 16 bytes");
+
+class RATSDataLog {
+public:
+    // Open (or create) the log files on the SD card started by StratoCore.
+    // Returns false if they can't be opened.
+    bool Begin();
+    // Append a payload. Returns its sequence number, or DATALOG_NO_SEQ.
+    uint32_t Append(DataLogType_t type, uint32_t epoch, const uint8_t* data, uint16_t length);
+    // Read the record seq into buffer. Returns false if it does not exist or does not fit.
+    bool Read(uint32_t seq, DataLogEntry_t& entry, uint8_t* buffer, uint16_t size);
+    // Flush the appends once DATALOG_FLUSH_MS has passed. Called from the main loop.
+    void Service();
+
+    bool Ready() const { return ready; }
+    // Sequence number of the next record
+    uint32_t NextSeq() const { return next_seq; }
+    // Appends that failed
+    uint32_t errors = 0;
+
+private:
+    void Flush();
+
+    File data_file;
+    File index_file;
+    bool ready = false;
+    uint32_t next_seq = 0;
+    // Appends since the last flush, and millis() of the first one
+    uint8_t unflushed = 0;
+    uint32_t unflushed_millis = 0;
+};
+
+#endif /* RATSDATALOG_H */
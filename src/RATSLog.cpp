@@ -0,0 +1,129 @@
+/*
+ *  RATSLog.cpp
+ *
+ *  Deferred binary logging, see RATSLog.h
+ */
+
+#include "RATSLog.h"
+#include "StratoCore.h"
+
+#define RATS_LOG_FORMAT(id, format) format,
+static const char* const log_formats[NUM_RATS_LOG_IDS] = {
+    RATS_LOG_MESSAGES(RATS_LOG_FORMAT)
+};
+#undef RATS_LOG_FORMAT
+
+// Records older than this when drained are logged with their age
+#define RATS_LOG_AGE_MS 100
+
+void RATSLog::Add(uint8_t level, RATSLogId_t id, RATSLogArg_t a0, RATSLogArg_t a1,
+    RATSLogArg_t a2, RATSLogArg_t a3)
+{
+    if (count == RATS_LOG_RING_SIZE) {
+        dropped++;
+        return;
+    }
+
+    RATSLogRecord_t& record = ring[(head + count) % RATS_LOG_RING_SIZE];
+    record.millis = millis();
+    record.id = id;
+    record.level = level;
+    // The format says how each argument is read back, so floats are stored as their bits
+    memcpy(&record.args[0], &a0.i, sizeof(int32_t));
+    memcpy(&record.args[1], &a1.i, sizeof(int32_t));
+    memcpy(&record.args[2], &a2.i, sizeof(int32_t));
+    memcpy(&record.args[3], &a3.i, sizeof(int32_t));
+
+    count++;
+    if (count > high_water) {
+        high_water = count;
+    }
+}
+
+bool RATSLog::Drain()
+{
+    if (dropped != dropped_reported) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "RATS log ring full, %lu records dropped", dropped - dropped_reported);
+        log_error(log_array);
+        dropped_reported = dropped;
+        return true;
+    }
+
+    if (!count) {
+        return false;
+    }
+
+    const RATSLogRecord_t& record = ring[head];
+    Expand(record, log_array, LOG_ARRAY_SIZE);
+    head = (head + 1) % RATS_LOG_RING_SIZE;
+    count--;
+
+    switch (record.level) {
+    case RLOG_ERROR:
+        log_error(log_array);
+        break;
+    case RLOG_DEBUG:
+        log_debug(log_array);
+        break;
+    default:
+        log_nominal(log_array);
+        break;
+    }
+
+    return true;
+}
+
+void RATSLog::Expand(const RATSLogRecord_t& record, char* buffer, size_t size)
+{
+    if (record.id >= NUM_RATS_LOG_IDS) {
+        snprintf(buffer, size, "Unknown log id %u", (unsigned)record.id);
+        return;
+    }
+
+    const char* format = log_formats[record.id];
+    size_t n = 0;
+    uint8_t arg = 0;
+    char spec[16];
+
+    // Copy the literal text, and format each conversion with its own argument
+    while (*format && n < size - 1) {
+        if (*format != '%') {
+            buffer[n++] = *format++;
+            continue;
+        }
+        uint8_t len = 0;
+        spec[len++] = *format++;
+        while (*format && !strchr("diuxXcfeEgG%", *format) && len < sizeof(spec) - 2) {
+            spec[len++] = *format++;
+        }
+        char conversion = *format;
+        if (!conversion) {
+            break;
+        }
+        spec[len++] = *format++;
+        spec[len] = '\0';
+
+        int32_t value = (arg < RATS_LOG_MAX_ARGS) ? record.args[arg] : 0;
+        int written;
+        if ('%' == conversion) {
+            written = snprintf(buffer + n, size - n, "%%");
+        } else if (strchr("feEgG", conversion)) {
+            float f;
+            memcpy(&f, &value, sizeof(float));
+            written = snprintf(buffer + n, size - n, spec, (double)f);
+            arg++;
+        } else {
+            written = snprintf(buffer + n, size - n, spec, value);
+            arg++;
+        }
+        if (written > 0) {
+            n += ((size_t)written < size - n) ? written : size - n - 1;
+        }
+    }
+    buffer[n] = '\0';
+
+    uint32_t age = millis() - record.millis;
+    if (age >= RATS_LOG_AGE_MS && n < size - 1) {
+        snprintf(buffer + n, size - n, " [%lu ms ago]", age);
+    }
+}
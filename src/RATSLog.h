@@ -0,0 +1,114 @@
+/*
+ *  RATSLog.h
+ *
+ *  Deferred logging for the high-rate paths. Each subsystem has its own
+ *  compile-time log level; a RATS_LOG() call above that level compiles to
+ *  nothing. Enabled calls store a compact binary record (message id, level,
+ *  timestamp and up to RATS_LOG_MAX_ARGS arguments) in a RAM ring, and the
+ *  text is only formatted and written to the debug log by Drain(), which
+ *  runs while the main loop is idle.
+ *
+ *  The ring is written and drained from the main loop only; do not log from
+ *  an ISR.
+ */
+
+#ifndef RATSLOG_H
+#define RATSLOG_H
+
+#include <Arduino.h>
+
+// Log levels, for the RATS_LOG_LEVEL_* settings
+#define RLOG_OFF        0
+#define RLOG_ERROR      1
+#define RLOG_NOMINAL    2
+#define RLOG_DEBUG      3
+
+// Per-subsystem log levels. Override with e.g. -DRATS_LOG_LEVEL_MCB=RLOG_DEBUG in platformio.ini
+#ifndef RATS_LOG_LEVEL_MODE         // Mode state machines
+#define RATS_LOG_LEVEL_MODE     RLOG_NOMINAL
+#endif
+#ifndef RATS_LOG_LEVEL_MCB          // MCB router and motion TM
+#define RATS_LOG_LEVEL_MCB      RLOG_NOMINAL
+#endif
+#ifndef RATS_LOG_LEVEL_LORA         // ECU LoRa RX
+#define RATS_LOG_LEVEL_LORA     RLOG_NOMINAL
+#endif
+
+#define RATS_LOG_RING_SIZE  128
+#define RATS_LOG_MAX_ARGS   4
+
+// Message ids and their formats. Integer arguments are 32 bits (%ld, %lu, %lx),
+// float arguments are formatted with %f/%e/%g.
+#define RATS_LOG_MESSAGES(X) \
+    X(RLOG_SB_LOOP,             "SB loop") \
+    X(RLOG_SA_LOOP,             "SA loop") \
+    X(RLOG_SA_ACK_WAIT,         "Waiting on safety ack") \
+    X(RLOG_LP_LOOP,             "LP loop") \
+    X(RLOG_EF_LOOP,             "EF loop") \
+    X(RLOG_FL_ERROR,            "In Error Sub State") \
+    X(RLOG_FL_SUBSTATE,         "inst_substate:%lu") \
+    X(RLOG_REEL_STATE,          "reel_state:%lu") \
+    X(RLOG_WARMUP_STATE,        "warmup_state:%lu") \
+    X(RLOG_REEL_POS,            "Reel pos: %.2f") \
+    X(RLOG_REEL_POS_UNKNOWN,    "Received MCB bin: unable to read position") \
+    X(RLOG_LORA_RX,             "LoRa rx n:%ld id:%ld rssi:%ld snr:%.1f") \
+    X(RLOG_LORA_RX_STATS,       "LoRa rx ferr:%ld lost:%lu ovf:%lu") \
+    X(RLOG_LORA_LINK,           "LoRa link rssi:%.1f snr:%.1f loss:%.1f%% SF%lu") \
+    X(RLOG_LORA_COUNT,          "LoRa message count mismatch %lu %lu") \
+    X(RLOG_ACTION_STALE,        "Action %lu stale, dropped unchecked (%lu total)")
+
+#define RATS_LOG_ENUM(id, format) id,
+enum RATSLogId_t : uint16_t {
+    RATS_LOG_MESSAGES(RATS_LOG_ENUM)
+    NUM_RATS_LOG_IDS
+};
+#undef RATS_LOG_ENUM
+
+// Log message id with arguments from subsystem sub (MODE, MCB, LORA) at level.
+// Removed at compile time if RATS_LOG_LEVEL_<sub> is below level.
+#define RATS_LOG(sub, level, id, ...) \
+    do { if (RATS_LOG_LEVEL_##sub >= (level)) rats_log.Add((level), (id), ##__VA_ARGS__); } while (0)
+
+// One log argument, integer or float
+struct RATSLogArg_t {
+    RATSLogArg_t(float v) : is_float(true) { f = v; }
+    RATSLogArg_t(double v) : is_float(true) { f = (float)v; }
+    template <typename T>
+    RATSLogArg_t(T v) : is_float(false) { i = (int32_t)v; }
+    union {
+        int32_t i;
+        float f;
+    };
+    bool is_float;
+};
+
+struct RATSLogRecord_t {
+    uint32_t millis;
+    RATSLogId_t id;
+    uint8_t level;
+    int32_t args[RATS_LOG_MAX_ARGS];
+};
+
+class RATSLog {
+public:
+    // Store a record; if the ring is full the record is dropped and counted
+    void Add(uint8_t level, RATSLogId_t id, RATSLogArg_t a0 = 0, RATSLogArg_t a1 = 0,
+        RATSLogArg_t a2 = 0, RATSLogArg_t a3 = 0);
+    // Format and log the oldest record. Returns false if the ring is empty.
+    bool Drain();
+
+    uint16_t Used() const { return count; }
+    // Records dropped because the ring was full
+    uint32_t dropped = 0;
+    uint16_t high_water = 0;
+
+private:
+    void Expand(const RATSLogRecord_t& record, char* buffer, size_t size);
+
+    RATSLogRecord_t ring[RATS_LOG_RING_SIZE];
+    uint16_t head = 0;
+    uint16_t count = 0;
+    uint32_t dropped_reported = 0;
+};
+
+#endif /* RATSLOG_H */
@@ -0,0 +1,71 @@
+/*
+ *  RATSScheduler.cpp
+ *
+ *  Priority action scheduler, see RATSScheduler.h
+ */
+
+#include "RATSScheduler.h"
+
+bool RATSScheduler::Add(uint8_t action, uint8_t priority, uint32_t delay_ms)
+{
+    Remove(action);
+
+    if (count == RATS_SCHEDULE_SIZE) {
+        // Evict the lowest priority entry, if it is lower than this one
+        uint8_t lowest = 0;
+        for (uint8_t i = 1; i < count; i++) {
+            if (queue[i].priority < queue[lowest].priority) {
+                lowest = i;
+            }
+        }
+        dropped++;
+        if (queue[lowest].priority >= priority) {
+            return false;
+        }
+        queue[lowest] = queue[--count];
+    }
+
+    queue[count].due_ms = millis() + delay_ms;
+    queue[count].action = action;
+    queue[count].priority = priority;
+    count++;
+    if (count > high_water) {
+        high_water = count;
+    }
+    return true;
+}
+
+void RATSScheduler::Remove(uint8_t action)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (queue[i].action == action) {
+            queue[i] = queue[--count];
+            return;
+        }
+    }
+}
+
+bool RATSScheduler::PopDue(uint8_t& action)
+{
+    uint32_t now = millis();
+    int16_t best = -1;
+
+    for (uint8_t i = 0; i < count; i++) {
+        // Wrap-safe due check
+        if ((int32_t)(now - queue[i].due_ms) < 0) {
+            continue;
+        }
+        if (best < 0 || queue[i].priority > queue[best].priority ||
+            (queue[i].priority == queue[best].priority && (int32_t)(queue[i].due_ms - queue[best].due_ms) < 0)) {
+            best = i;
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+
+    action = queue[best].action;
+    queue[best] = queue[--count];
+    return true;
+}
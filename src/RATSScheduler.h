@@ -0,0 +1,43 @@
+/*
+ *  RATSScheduler.h
+ *
+ *  Millisecond resolution action scheduler with priorities. Each action can
+ *  be pending at most once; scheduling it again replaces the earlier entry.
+ *  When several actions are due at the same time, the highest priority
+ *  action is popped first. If the queue is full, the lowest priority pending
+ *  action is evicted to make room for a higher priority one.
+ */
+
+#ifndef RATSSCHEDULER_H
+#define RATSSCHEDULER_H
+
+#include <Arduino.h>
+
+#define RATS_SCHEDULE_SIZE 16
+
+struct ScheduledAction_t {
+    uint32_t due_ms;
+    uint8_t action;
+    uint8_t priority;
+};
+
+class RATSScheduler {
+public:
+    // Schedule action to be due delay_ms from now. Returns false if it was dropped.
+    bool Add(uint8_t action, uint8_t priority, uint32_t delay_ms);
+    // Remove a pending action
+    void Remove(uint8_t action);
+    // Pop the highest priority action that is due. Returns false if none is due.
+    bool PopDue(uint8_t& action);
+
+    uint8_t Pending() const { return count; }
+    // Actions dropped or evicted because the queue was full
+    uint32_t dropped = 0;
+    uint8_t high_water = 0;
+
+private:
+    ScheduledAction_t queue[RATS_SCHEDULE_SIZE];
+    uint8_t count = 0;
+};
+
+#endif /* RATSSCHEDULER_H */
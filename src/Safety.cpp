@@ -19,7 +19,7 @@ void StratoRATS::SafetyMode()
     case SA_ENTRY:
         RATS_Shutdown();
         // Register ACTION_RATS_REPORT to trigger the first status message 
-        scheduler.AddAction(ACTION_RATS_REPORT, 1);
+        ScheduleAction(ACTION_RATS_REPORT, 1000);
         log_nominal(" Shut down, Entering SA");
         inst_substate = SA_SEND_S;
         log_nominal("Entering SA_SEND_S");
@@ -27,12 +27,12 @@ void StratoRATS::SafetyMode()
     case SA_SEND_S:
         log_nominal("Sending safety message");
         zephyrTX.S();
-        scheduler.AddAction(RESEND_SAFETY, 60);
+        ScheduleAction(RESEND_SAFETY, ZEPHYR_RESEND_TIMEOUT * 1000UL);
         inst_substate = SA_ACK_WAIT;
         log_nominal("Entering SA_ACK_WAIT");
         break;
     case SA_ACK_WAIT:
-        log_debug("Waiting on safety ack");
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_SA_ACK_WAIT);
         // check if the ack has been received
         if (S_ack_flag == ACK) {
             // clear the ack flag and go to the loop
@@ -51,7 +51,7 @@ void StratoRATS::SafetyMode()
         break;
     case SA_LOOP:
         // nominal ops
-        log_debug("SA loop");
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_SA_LOOP);
         break;
     case SA_SHUTDOWN:
         RATS_Shutdown();
@@ -17,25 +17,25 @@ void StratoRATS::StandbyMode()
         log_nominal("Entering SB");
         RATS_Shutdown();
         // send mode request in first loop
-        scheduler.AddAction(SEND_IMR, 0);
+        ScheduleAction(SEND_IMR, 0);
         // Register ACTION_RATS_REPORT to trigger the first status message 
-        scheduler.AddAction(ACTION_RATS_REPORT, 1);
+        ScheduleAction(ACTION_RATS_REPORT, 1000);
         inst_substate = SB_LOOP;
         log_nominal("Entering SB_LOOP");
         break;
     case SB_LOOP:
         // nominal ops
-        log_debug("SB loop");
+        RATS_LOG(MODE, RLOG_DEBUG, RLOG_SB_LOOP);
         // send a mode request if time, and schedule the next
         if (CheckAction(SEND_IMR)) {
             log_nominal("Sending mode request to OBC");
             zephyrTX.IMR();
-            scheduler.AddAction(SEND_IMR, 5);
+            ScheduleAction(SEND_IMR, 5000);
         }
         if (CheckAction(ACTION_LORA_TX_TEST) && lora_tx_test) {
             const char* msg = "LoRa TX test message from StratoCore_RATS abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*()_+-=[]{}|;:,.<>?";
             ecu_lora_tx((uint8_t*)msg, strlen(msg), true);
-            scheduler.AddAction(ACTION_LORA_TX_TEST, 1);
+            ScheduleAction(ACTION_LORA_TX_TEST, 1000);
         }
         break;
     case SB_SHUTDOWN:
@@ -1,10 +1,18 @@
 #include "StratoRATS.h"
+#include "Serialize.h"
 #include <SPI.h>
 
+// Shared buffer storage, in RAM2
+DMAMEM static uint8_t rats_arena_buffer[RATS_ARENA_SIZE];
+
 StratoRATS::StratoRATS()
-    : StratoCore(&ZEPHYR_SERIAL, INSTRUMENT)
+    : ZephyrTXHolder(&ZEPHYR_SERIAL)
+    , StratoCore(&zephyr_tx, INSTRUMENT)
     , mcbComm(&MCB_SERIAL)
+    , loop_profiler(LOOP_TENTHS * 100000)
+    , rats_arena(rats_arena_buffer, RATS_ARENA_SIZE)
 {
+    MCB_TM_buffer = rats_arena.Data();
 }
 
 void StratoRATS::InstrumentSetup()
@@ -38,21 +46,45 @@ void StratoRATS::InstrumentSetup()
     } else {
         log_nominal("LoRa Initialized");
     }; 
+    LoRaLinkInit();
 
     if (!ratsConfigs.Initialize()) {
         ZephyrLogWarn("Error loading from EEPROM! Reconfigured");
+    } else if (ratsConfigs.defaulted) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "EEPROM configs migrated, %u loaded, %u set to defaults",
+            ratsConfigs.loaded, ratsConfigs.defaulted);
+        ZephyrLogFine(log_array);
+        log_nominal(log_array);
+    }
+
+    if (!data_log.Begin()) {
+        log_error("WARN: SD data log unavailable");
+        ZephyrLogWarn("WARN: SD data log unavailable");
+    } else {
+        snprintf(log_array, LOG_ARRAY_SIZE, "SD data log opened, next seq %lu", data_log.NextSeq());
+        log_nominal(log_array);
     }
 
     mcbComm.AssignBinaryRXBuffer(binary_mcb, MCB_BINARY_BUFFER_SIZE);
 
+    // The serial buffer memory is added in setup()
+#ifndef LOG_ZEPHYR_COMMS_SHARED
+    zephyr_serial_stats.rx_size = ZEPHYR_SERIAL_BUFFER_SIZE;
+    zephyr_serial_stats.tx_size = ZEPHYR_SERIAL_BUFFER_SIZE;
+#endif
+    mcb_serial_stats.rx_size = MCB_SERIAL_BUFFER_SIZE;
+    mcb_serial_stats.tx_size = MCB_SERIAL_BUFFER_SIZE;
+
+    MemoryReport();
+
     // Initialize the RATSReport.
     last_rats_report = now();
 
-    rats_report_header.header_size_bytes = RATS_HEADER_SIZE_BYTES;
-    rats_report_header.num_ecu_records = 0;
-    rats_report_header.ecu_pwr_on = 0;
-    rats_report_header.v56 = 0;
-    rats_report_header.ecu_record_size_bytes = ECU_REPORT_SIZE_BYTES;
+    ratsReportConfigure();
+    for (uint i = 0; i < RATS_REPORT_SLOTS; i++) {
+        ratsReportReset(rats_reports[i]);
+    }
+    rats_fill_slot = 0;
 }
 
 void StratoRATS::InstrumentLoop()
@@ -61,6 +93,25 @@ void StratoRATS::InstrumentLoop()
     
     WatchFlags();
 
+    MCBQueueService();
+
+    DataLogReplay();
+    data_log.Service();
+
+    // Commit config changes once a burst of TCs has settled. A failing
+    // commit is retried with a backoff, and only reported when it starts failing.
+    bool commit_failing = ratsConfigs.Failing();
+    ratsConfigs.Service();
+    if (ratsConfigs.Failing() != commit_failing) {
+        if (commit_failing) {
+            ZephyrLogFine("EEPROM config commit succeeded");
+            log_nominal("EEPROM config commit succeeded");
+        } else {
+            ZephyrLogWarn("EEPROM config commit failed, retrying");
+            log_error("EEPROM config commit failed, retrying");
+        }
+    }
+
     // Insure that the LoRa test tx is only operating in standby mode
     if (my_inst_mode != MODE_STANDBY) {
         lora_tx_test = false;
@@ -68,42 +119,208 @@ void StratoRATS::InstrumentLoop()
 
     // Check for incoming LoRa messages
     LoRaRX();
+    LoRaLinkService();
+
+    SampleSerialBuffers();
 
     // Keep the serial port alive. The MAX3381 has a 30 second timeout,
     // so we send a character every 29 seconds to keep it alive.
     int32_t millis_delta = (int32_t) (millis() - serial_keepalive_millis);
     if (millis_delta > 29000 || millis_delta < 0) {
-        ZEPHYR_SERIAL.write('\n');
+        zephyr_tx.write('\n');
         serial_keepalive_millis = millis();
     }
 }
 
+void StratoRATS::PostEvent(uint8_t event)
+{
+    // Called from ISRs and from the serialEvent handlers, so keep this short.
+    // Mask interrupts (restoring the caller's mask) so that a tick posted by
+    // the Timer1 ISR can't be lost in the read-modify-write below.
+    uint32_t primask;
+    __asm__ volatile ("mrs %0, primask" : "=r" (primask));
+    __disable_irq();
+
+    uint32_t t = micros();
+    if ((event & EVENT_ZEPHYR_RX) && !(pending_events & EVENT_ZEPHYR_RX)) {
+        zephyr_rx_micros = t;
+    }
+    if ((event & EVENT_MCB_RX) && !(pending_events & EVENT_MCB_RX)) {
+        mcb_rx_micros = t;
+    }
+    if ((event & EVENT_TICK) && (pending_events & EVENT_TICK)) {
+        loop_profiler.missed_ticks++;
+    }
+    for (uint8_t i = 0; i < NUM_RATS_EVENTS; i++) {
+        if ((event & (1 << i)) && !(pending_events & (1 << i))) {
+            event_micros[i] = t;
+        }
+    }
+    pending_events |= event;
+
+    if (!primask) {
+        __enable_irq();
+    }
+}
+
+uint8_t StratoRATS::TakeEvents()
+{
+    noInterrupts();
+    uint8_t events = pending_events;
+    pending_events = 0;
+    interrupts();
+
+    return events;
+}
+
+void StratoRATS::SendTM()
+{
+    zephyrTX.TM();
+    last_tm_frame = zephyr_tx.MarkFrame();
+    SampleSerialBuffers();
+}
+
+TMTXStatus_t StratoRATS::TMStatus(uint32_t frame)
+{
+    TMTXStatus_t status = zephyr_tx.Status(frame);
+    if (TM_TX_SENT == status && frame == tm_answered_frame) {
+        status = tm_answered_ack ? TM_TX_ACKED : TM_TX_NAKED;
+    }
+
+    return status;
+}
+
+void StratoRATS::TMAckReceived(bool ack)
+{
+    // Every TM shares TM_ack_flag, so a TMAck is only pinned to a TM if that
+    // TM has been sent and nothing has been written to the Zephyr after it.
+    uint32_t frame = zephyr_tx.MarkFrame();
+    if (frame == last_tm_frame && TM_TX_SENT == zephyr_tx.Status(frame)) {
+        tm_answered_frame = frame;
+        tm_answered_ack = ack;
+    }
+}
+
+void StratoRATS::SampleSerialBuffers()
+{
+    zephyr_serial_stats.Sample(ZEPHYR_SERIAL);
+    mcb_serial_stats.Sample(MCB_SERIAL);
+}
+
+void StratoRATS::RunZephyrRouter()
+{
+    zephyr_serial_stats.Sample(ZEPHYR_SERIAL);
+
+    // TM_ack_flag only changes when a TMAck arrives, so clear it to see each one.
+    // It is put back for the code that polls it, unless a TM was sent meanwhile.
+    auto tm_ack = TM_ack_flag;
+    uint32_t tm_frame = last_tm_frame;
+    TM_ack_flag = NO_ACK;
+
+    RunRouter();
+
+    if (NO_ACK != TM_ack_flag) {
+        TMAckReceived(ACK == TM_ack_flag);
+    } else if (tm_frame == last_tm_frame) {
+        TM_ack_flag = tm_ack;
+    }
+
+    // StratoCore sends the TC ACK as soon as TCHandler() returns
+    if (tc_received) {
+        tc_received = false;
+        tc_ack_latency.Add(micros() - zephyr_rx_micros);
+    }
+}
+
+void StratoRATS::LoRaISR()
+{
+    // The radio is read in LoRaRX(), so that SPI1 is only used from the main loop
+    PostEvent(EVENT_LORA_RX);
+}
+
+void StratoRATS::LoRaAttachISR(void (*isr)(void))
+{
+    lora_isr = isr;
+    attachInterrupt(digitalPinToInterrupt(RATS_LORA_INT), lora_isr, RISING);
+}
+
+void StratoRATS::LoRaMaskISR()
+{
+    if (lora_isr) {
+        detachInterrupt(digitalPinToInterrupt(RATS_LORA_INT));
+    }
+}
+
+void StratoRATS::LoRaUnmaskISR()
+{
+    if (lora_isr) {
+        attachInterrupt(digitalPinToInterrupt(RATS_LORA_INT), lora_isr, RISING);
+        // An RX done edge while detached is picked up by the next LoRaRX()
+        PostEvent(EVENT_LORA_RX);
+    }
+}
+
+void StratoRATS::LoRaRead()
+{
+    LoRaFrame_t frame;
+
+    while (ecu_lora_rx(&frame.msg)) {
+        frame.rssi = ecu_lora_rssi();
+        frame.snr = ecu_lora_snr();
+        frame.ferr = ecu_lora_frequency_error();
+        if (lora_rx_queue.full()) {
+            lora_rx_overflows++;
+        } else {
+            lora_rx_queue.push(frame);
+        }
+    }
+}
+
 void StratoRATS::LoRaRX()
 {
-    if (ecu_lora_rx(&lora_msg)) {
+    // Polled as well as on EVENT_LORA_RX, so a missed RX done edge only
+    // delays a frame until the next tick.
+    LoRaRead();
+
+    while (!lora_rx_queue.empty()) {
+        lora_frame = lora_rx_queue.front();
+        lora_rx_queue.pop();
+        ECULoRaMsg_t& lora_msg = lora_frame.msg;
+
         total_lora_count++;
+        uint32_t radio_losses = 0;
         if (lora_msg.count != total_lora_count) {
-            log_error(String(String("LoRa message count mismatch ") + String(lora_msg.count) + " " + String(total_lora_count)).c_str());
+            // Frames that we dropped ourselves are not radio losses
+            uint32_t overflows = lora_rx_overflows;
+            uint32_t dropped = overflows - lora_rx_overflows_counted;
+            lora_rx_overflows_counted = overflows;
+            uint32_t gap = (lora_msg.count > total_lora_count) ? lora_msg.count - total_lora_count : 0;
+            if (gap > dropped) {
+                radio_losses = gap - dropped;
+                lora_radio_losses += radio_losses;
+                RATS_LOG(LORA, RLOG_ERROR, RLOG_LORA_COUNT, lora_msg.count, total_lora_count);
+            }
             total_lora_count = lora_msg.count;
         }
-//#if EXTRA_LOGGING
-    ECUReportBytes_t payload;
-    for (uint8_t i = 0; i < lora_msg.data_len; i++) {
-        payload[i] = lora_msg.data[i];
-    }
-
-    // Add the LoRa message to the RATS report.
-    ratsReportAccumulate(payload);
-
-    if (lora_msg.count % 30 == 0) {
-            snprintf(log_array, LOG_ARRAY_SIZE,
-                "LoRa rx n:%ld id:%ld rssi:%d snr:%.1f ferr:%ld",
-                lora_msg.count, lora_msg.id, ecu_lora_rssi(), ecu_lora_snr(), ecu_lora_frequency_error());
+        ECUConfigCheck();
+        LoRaLinkFrame(lora_frame, radio_losses);
+        WarmupLoRaFrame(lora_frame);
+
+        // Add the LoRa message to the RATS report.
+        uint8_t* record = ratsReportAccumulate(lora_msg.data, lora_msg.data_len);
+
+        if (record && (lora_msg.count % 30 == 0)) {
+            RATS_LOG(LORA, RLOG_NOMINAL, RLOG_LORA_RX, lora_msg.count, lora_msg.id, lora_frame.rssi, lora_frame.snr);
+            RATS_LOG(LORA, RLOG_NOMINAL, RLOG_LORA_RX_STATS, lora_frame.ferr, lora_radio_losses, lora_rx_overflows);
+            RATS_LOG(LORA, RLOG_NOMINAL, RLOG_LORA_LINK, lora_link.rssi, lora_link.snr, 100.0f * lora_link.LossRate(), LoRaLinkSF());
+#if RATS_LOG_LEVEL_LORA >= RLOG_DEBUG
+            // The decoded report is printed directly, so only at debug level
+            ECUReportBytes_t payload;
+            memcpy(payload.data(), record, ECU_REPORT_SIZE_BYTES);
             ECUReport_t ecu_report = ecu_report_deserialize(payload);
             ecu_report_print(ecu_report);
-            log_nominal(log_array);
+#endif
         }
-//#endif
     }
 }
 
@@ -146,176 +363,468 @@ void StratoRATS::SetAction(uint8_t action)
 
 void StratoRATS::WatchFlags()
 {
-    // monitor for and clear stale flags
+    // monitor for, count and clear stale flags
     for (int i = 0; i < NUM_ACTIONS; i++) {
         if (action_flags[i].flag_value) {
             action_flags[i].stale_count++;
             if (action_flags[i].stale_count >= FLAG_STALE) {
                 action_flags[i].flag_value = false;
                 action_flags[i].stale_count = 0;
+                stale_actions++;
+                stale_action_counts[i]++;
+                RATS_LOG(MODE, RLOG_NOMINAL, RLOG_ACTION_STALE, i, stale_actions);
             }
         }
     }
 }
 
+// Scheduler priority of each action. When several actions are due together, the
+// higher priority flags are set first, and a full schedule evicts the lowest.
+static const uint8_t action_priority[NUM_ACTIONS] = {
+    0,  // NO_ACTION
+    1,  // SEND_IMR
+    2,  // RESEND_RA
+    3,  // RESEND_MOTION_COMMAND
+    2,  // RESEND_TM
+    3,  // RESEND_SAFETY
+    1,  // ACTION_START_TELEMETRY
+    0,  // ACTION_GPS_WAIT_MSG
+    1,  // ACTION_RATS_REPORT
+    2,  // ACTION_REEL_OUT
+    2,  // ACTION_REEL_IN
+    2,  // ACTION_IN_NO_LW
+    0,  // ACTION_LORA_TX_TEST
+    4,  // ACTION_MOTION_STOP
+    4,  // ACTION_MOTION_TIMEOUT
+    4,  // ACTION_MOTION_HEALTH
+    2,  // ACTION_PROFILE_START
+    2,  // ACTION_PROFILE_DWELL
+    0,  // ACTION_DATALOG_REPLAY
+    2,  // ACTION_DUTY_ON
+};
+static_assert(NUM_ACTIONS == 20, "Update action_priority[] when adding an action");
+
+void StratoRATS::ScheduleAction(uint8_t action, uint32_t delay_ms)
+{
+    if (action >= NUM_ACTIONS) {
+        log_error("Out of bounds action schedule");
+        return;
+    }
+
+    // An unchecked flag from the earlier schedule is replaced as well
+    action_flags[action].flag_value = false;
+    if (!rats_scheduler.Add(action, action_priority[action], delay_ms)) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "Action schedule full, action %u dropped", action);
+        log_error(log_array);
+    }
+}
+
+void StratoRATS::CancelAction(uint8_t action)
+{
+    if (action >= NUM_ACTIONS) {
+        log_error("Out of bounds action cancel");
+        return;
+    }
+
+    rats_scheduler.Remove(action);
+    action_flags[action].flag_value = false;
+    action_flags[action].stale_count = 0;
+}
+
+void StratoRATS::RunRATSScheduler()
+{
+    uint8_t action;
+    while (rats_scheduler.PopDue(action)) {
+        SetAction(action);
+    }
+}
+
 void StratoRATS::RATS_Shutdown()
 {
     // Turn off the ECU
     ECUControl(false);
+    // No motion TM to wait for, or profile leg overrides, once the flight state machine has stopped
+    MCBTMAckDone();
+    reel_skip_tm_ack = false;
+    motion_velocity = 0.0f;
+    motion_decimation_override = 0;
+}
+
+void StratoRATS::ratsReportConfigure()
+{
+    rats_batch_records = min(ratsConfigs.report_records.Read(), (uint16_t)NUM_ECU_REPORTS);
+    rats_period_secs = ratsConfigs.report_period.Read();
+}
+
+void StratoRATS::ratsReportAdapt()
+{
+    if (!rats_tm_ack_pending) {
+        return;
+    }
+
+    // Measure the ACK latency from when the TM has left the serial TX buffer
+    if (TM_TX_QUEUED == TMStatus(rats_tm_frame)) {
+        rats_tm_sent_millis = millis();
+        return;
+    }
+
+    TMTXStatus_t status = TMStatus(rats_tm_frame);
+    uint32_t ack_millis = millis() - rats_tm_sent_millis;
+    bool busy;
+    if (TM_TX_ACKED == status) {
+        rats_tm_ack_latency.Add(1000 * ack_millis);
+        busy = (ack_millis > RATS_ADAPT_BUSY_MS);
+    } else if (TM_TX_NAKED == status || ack_millis > 1000 * ZEPHYR_RESEND_TIMEOUT) {
+        rats_tm_naks++;
+        busy = true;
+        snprintf(log_array, LOG_ARRAY_SIZE, "RATS report seq %lu not ACKed, kept in the SD data log", rats_tm_seq);
+        log_error(log_array);
+    } else if (last_tm_frame != rats_tm_frame) {
+        // Another TM went out before the answer, so it can't be told apart
+        rats_tm_ack_pending = false;
+        return;
+    } else {
+        return; // still waiting
+    }
+    rats_tm_ack_pending = false;
+
+    if (!ratsConfigs.report_adaptive.Read()) {
+        return;
+    }
+
+    // The batch can't grow past what a report slot holds
+    uint32_t base_records = min(ratsConfigs.report_records.Read(), (uint16_t)NUM_ECU_REPORTS);
+    uint32_t max_records = min(base_records * RATS_ADAPT_MAX_FACTOR, (uint32_t)NUM_ECU_REPORTS);
+    uint32_t batch = rats_batch_records;
+    if (busy) {
+        batch = min(batch * 2, max_records);
+    } else if (ack_millis < RATS_ADAPT_FAST_MS) {
+        batch = max(batch / 2, base_records);
+    }
+
+    if (batch != rats_batch_records) {
+        rats_batch_records = batch;
+        rats_period_secs = (uint32_t)ratsConfigs.report_period.Read() * batch / base_records;
+        snprintf(log_array, LOG_ARRAY_SIZE, "RATS report cadence: %lu records, %lu s (ack %lu ms)",
+            batch, rats_period_secs, ack_millis);
+        log_nominal(log_array);
+    }
 }
 
 void StratoRATS::ratsReportCheck(bool timed_check)
 {
+    ratsReportAdapt();
+
+    // Reports keep accumulating in the slots until the motion TM has been ACKed
+    if (mcb_tm_ack_wait) {
+        return;
+    }
+
     if (!timed_check)
     {
         if (CheckAction(ACTION_RATS_REPORT))
         {
             ratsReportTM();
             last_rats_report = now();
-            scheduler.AddAction(ACTION_RATS_REPORT, RATS_REPORT_PERIOD_SECS);
+            ScheduleAction(ACTION_RATS_REPORT, rats_period_secs * 1000UL);
+            return;
         }
     }
     else
     {
-        if (rats_report_header.num_ecu_records >= NUM_ECU_REPORTS || ((now() - last_rats_report) > RATS_REPORT_PERIOD_SECS))
+        if ((uint32_t)(now() - last_rats_report) > rats_period_secs)
         {
             ratsReportTM();
             last_rats_report = now();
+            return;
         }
     }
+
+    // Full reports are sealed by ratsReportAccumulate(), send them right away
+    if (ratsReportOldestSealed())
+    {
+        ratsReportTM();
+        last_rats_report = now();
+    }
 }
 
 void StratoRATS::ECUControl(bool enable)
 {
+    // ECU on-time, for the energy per ECU record
+    bool was_on = digitalRead(ECU_PWR_EN);
+    if (enable && !was_on) {
+        ecu_on_millis = millis();
+    } else if (!enable && was_on) {
+        ecu_on_total_ms += millis() - ecu_on_millis;
+    }
+
     if (enable) {
+        // The ECU starts at the boot LoRa rate
+        if (!was_on) {
+            LoRaLinkReset();
+        }
         digitalWrite(ECU_PWR_EN, HIGH);
         log_nominal("ECU Power Enabled");
     } else {
         digitalWrite(ECU_PWR_EN, LOW);
         log_nominal("ECU Power Disabled");
+        // Unsent parameters must be sent again once the ECU is back
+        ecu_config_pending |= ecu_config_sent;
+        ecu_config_sent = 0;
     }
 }
 
-void::StratoRATS::ratsReportAccumulate(ECUReportBytes_t& ecu_report_bytes) {
-    if (rats_report_header.num_ecu_records < NUM_ECU_REPORTS) {
-        memcpy(&rats_report_tm.records[rats_report_header.num_ecu_records], &ecu_report_bytes, ECU_REPORT_SIZE_BYTES);
-        rats_report_header.num_ecu_records++;
-    } else {
+uint8_t* StratoRATS::ratsReportAccumulate(const uint8_t* ecu_record, uint8_t len) {
+    if (len > ECU_REPORT_SIZE_BYTES) {
+        log_error("ECU record too long");
+        return nullptr;
+    }
+    if (rats_reports[rats_fill_slot].sealed && !ratsReportNextSlot()) {
+        rats_report_drops++;
         log_error("RATS report buffer full");
+        return nullptr;
+    }
+
+    RATSReportSlot_t& slot = rats_reports[rats_fill_slot];
+    uint8_t* dst = slot.tm.records + slot.bytes_used;
+    uint8_t* record;
+    uint16_t max_record_bytes;
+
+    if (slot.header.changed_bytes) {
+        slot.bytes_used += ratsReportChangedBytesEncode(slot, ecu_record, len, dst);
+        record = slot.prev_record;
+        max_record_bytes = ECU_CHANGED_BITMAP_BYTES + ECU_REPORT_SIZE_BYTES;
+    } else {
+        memcpy(dst, ecu_record, len);
+        memset(dst + len, 0, ECU_REPORT_SIZE_BYTES - len);
+        slot.bytes_used += ECU_REPORT_SIZE_BYTES;
+        record = dst;
+        max_record_bytes = ECU_REPORT_SIZE_BYTES;
+    }
+    slot.header.num_ecu_records++;
+    ecu_records++;
+
+    // Seal when the batch is complete, or when the worst case next record would not fit
+    if (slot.header.num_ecu_records >= rats_batch_records
+        || sizeof(slot.tm.records) - slot.bytes_used < max_record_bytes) {
+        ratsReportSeal();
     }
+
+    return record;
 }
 
-void StratoRATS::ratsReportTM() {
+uint16_t StratoRATS::ratsReportChangedBytesEncode(RATSReportSlot_t& slot, const uint8_t* ecu_record, uint8_t len, uint8_t* dst) {
+    uint8_t* changed = dst + ECU_CHANGED_BITMAP_BYTES;
 
-    zephyrTX.clearTm();
+    memset(dst, 0, ECU_CHANGED_BITMAP_BYTES);
+    etl::span<uint8_t> bitmap_span(dst, ECU_CHANGED_BITMAP_BYTES);
+    etl::bit_stream_writer writer(bitmap_span, etl::endian::big);
+
+    for (uint i = 0; i < ECU_REPORT_SIZE_BYTES; i++) {
+        uint8_t b = (i < len) ? ecu_record[i] : 0;
+        bool differs = (b != slot.prev_record[i]);
+        writer.write_unchecked(differs);
+        if (differs) {
+            *changed++ = b;
+            slot.prev_record[i] = b;
+        }
+    }
+
+    return changed - dst;
+}
+
+void StratoRATS::ratsReportSeal() {
+    RATSReportSlot_t& slot = rats_reports[rats_fill_slot];
+    RATSReportHeader_t& header = slot.header;
 
     // Fill in the RATS report header
-    rats_report_header.ecu_pwr_on = digitalRead(ECU_PWR_EN);
-    rats_report_header.v56 = 1000*analogRead(V56_MON) * (3.3 / 1024.0) * (R8 + R9) / R8;
-    rats_report_header.ecu_record_size_bytes = ECU_REPORT_SIZE_BYTES;
+    header.ecu_pwr_on = digitalRead(ECU_PWR_EN);
+    header.v56 = 1000*analogRead(V56_MON) * (3.3 / 1024.0) * (R8 + R9) / R8;
+    header.ecu_record_size_bytes = ECU_REPORT_SIZE_BYTES;
+    header.link_rssi = constrain(-lora_link.rssi, 0.0f, 255.0f);
+    header.link_snr = constrain(4.0f * lora_link.snr, -128.0f, 127.0f);
+    header.link_loss = 200.0f * lora_link.LossRate();
+    header.link_sf = LoRaLinkSF();
+    header.link_bw = LoRaLinkBW();
+
+    // Serialize the header into slot.tm.header_bytes
+    etl::span<uint8_t> header_span(slot.tm.header_bytes, RATS_HEADER_SIZE_BYTES);
+    etl::bit_stream_writer writer(header_span, etl::endian::big);
+    writer.write_unchecked(header.header_size_bytes, 8);       // Set in ratsReportReset()
+    writer.write_unchecked(header.num_ecu_records, 16);        // Set in ratsReportAccumulate()
+    writer.write_unchecked(header.ecu_record_size_bytes, 16);
+    writer.write_unchecked(header.ecu_pwr_on, 1);
+    writer.write_unchecked(header.v56, 13);
+    writer.write_unchecked(header.changed_bytes, 1);         // Set in ratsReportReset()
+    writer.write_unchecked(header.spare, 1);
+    writer.write_unchecked(header.link_rssi, 8);
+    writer.write_unchecked((uint8_t)header.link_snr, 8);
+    writer.write_unchecked(header.link_loss, 8);
+    writer.write_unchecked(header.link_sf, 4);
+    writer.write_unchecked(header.link_bw, 4);
+
+    slot.length = RATS_HEADER_SIZE_BYTES + slot.bytes_used;
+    slot.sealed = true;
+
+    // If this fails, ratsReportAccumulate() will try again with the next record
+    ratsReportNextSlot();
+}
+
+bool StratoRATS::ratsReportNextSlot() {
+    uint8_t next = (rats_fill_slot + 1) % RATS_REPORT_SLOTS;
+    RATSReportSlot_t& slot = rats_reports[next];
+
+    if (slot.sealed) {
+        if (RATS_REPORT_FULL_POLICY != REPORT_FULL_OVERWRITE_OLDEST) {
+            return false;
+        }
+        // Slots are filled in order, so the next one is the oldest
+        rats_report_drops += slot.header.num_ecu_records;
+        log_error("RATS report slots full, discarding oldest report");
+    }
+
+    ratsReportReset(slot);
+    rats_fill_slot = next;
+
+    return true;
+}
+
+void StratoRATS::ratsReportReset(RATSReportSlot_t& slot) {
+    slot.header.header_size_bytes = RATS_HEADER_SIZE_BYTES;
+    slot.header.num_ecu_records = 0;
+    slot.header.ecu_pwr_on = 0;
+    slot.header.v56 = 0;
+    slot.header.ecu_record_size_bytes = ECU_REPORT_SIZE_BYTES;
+    slot.header.spare = 0;
+    slot.header.link_rssi = 0;
+    slot.header.link_snr = 0;
+    slot.header.link_loss = 0;
+    slot.header.link_sf = 0;
+    slot.header.link_bw = 0;
+    uint16_t format = ratsConfigs.data_proc_method.Read();
+#ifdef RATS_BENCH
+    if (bench_active) {
+        format = bench_format;
+    }
+#endif
+    slot.header.changed_bytes = (REPORT_FORMAT_CHANGED_BYTES == format);
+    slot.sealed = false;
+    slot.length = 0;
+    slot.bytes_used = 0;
+    memset(slot.prev_record, 0, ECU_REPORT_SIZE_BYTES);
+}
+
+StratoRATS::RATSReportSlot_t* StratoRATS::ratsReportOldestSealed() {
+    // Slots are sealed in order, starting after the filling slot
+    for (uint i = 1; i <= RATS_REPORT_SLOTS; i++) {
+        RATSReportSlot_t& slot = rats_reports[(rats_fill_slot + i) % RATS_REPORT_SLOTS];
+        if (slot.sealed) {
+            return &slot;
+        }
+    }
+
+    return nullptr;
+}
+
+void StratoRATS::ratsReportTM() {
+
+    // A scheduled report with nothing sealed yet sends what has accumulated so far
+    RATSReportSlot_t* slot = ratsReportOldestSealed();
+    if (!slot) {
+        ratsReportSeal();
+        slot = ratsReportOldestSealed();
+        if (!slot) {
+            return;
+        }
+    }
+
+    zephyrTX.clearTm();
 
-    String Message = "";
+    const char* mode_name;
 
     // First
-    Message = "RATSReport";
     zephyrTX.setStateFlagValue(1, FINE);
-    zephyrTX.setStateDetails(1, Message);
+    zephyrTX.setStateDetails(1, "RATSReport");
 
     // Second
     zephyrTX.setStateFlagValue(2, FINE);
     switch (my_inst_mode) {
     case MODE_STANDBY:
-        Message = "STANDBY mode";
+        mode_name = "STANDBY mode";
         break;
     case MODE_FLIGHT:
-        Message = "FLIGHT mode";
+        mode_name = "FLIGHT mode";
         break;
     case MODE_LOWPOWER:
-        Message = "LOWPOWER mode";
+        mode_name = "LOWPOWER mode";
         break;
     case MODE_SAFETY:
-        Message = "SAFETY mode";
+        mode_name = "SAFETY mode";
         break;
     case MODE_EOF:
-        Message = "EOF mode";
+        mode_name = "EOF mode";
         break;
     default:
-        Message = "Unknown mode";
+        mode_name = "Unknown mode";
         break;
     }
-    Message += " " + String(rats_report_header.num_ecu_records) + " records";
-    zephyrTX.setStateDetails(2, Message);
+    // The sequence number lets the ground request a replay of a lost report
+    rats_tm_seq = DataLogAppend(DATALOG_RATS_REPORT, (uint8_t*)&slot->tm, slot->length);
+    snprintf(log_array, LOG_ARRAY_SIZE, "%s %u records seq %lu", mode_name, (unsigned)slot->header.num_ecu_records, rats_tm_seq);
+    zephyrTX.setStateDetails(2, log_array);
+
+    // Event loop latencies (mean/max in ms)
+    snprintf(log_array, LOG_ARRAY_SIZE, "Latency TC ack:%lu/%lu MCB ack:%lu/%lu TM ack:%lu/%lu ms, report drops:%lu naks:%lu",
+        tc_ack_latency.Mean()/1000, tc_ack_latency.max_us/1000,
+        mcb_ack_latency.Mean()/1000, mcb_ack_latency.max_us/1000,
+        rats_tm_ack_latency.Mean()/1000, rats_tm_ack_latency.max_us/1000,
+        rats_report_drops, rats_tm_naks);
+    log_nominal(log_array);
+    snprintf(log_array, LOG_ARRAY_SIZE, "Loop tick mean/max:%lu/%lu us, mode max:%lu us, overruns:%lu missed:%lu alloc loops:%lu",
+        loop_profiler.MeanUs(STAGE_TICK), loop_profiler.MaxUs(STAGE_TICK), loop_profiler.MaxUs(STAGE_MODE),
+        loop_profiler.overrun_ticks, (uint32_t)loop_profiler.missed_ticks, loop_profiler.alloc_loops);
+    log_nominal(log_array);
 
     // Third: GPS Position
-    Message = "";   
     zephyrTX.setStateFlagValue(3, FINE);
-    Message.concat(zephyrRX.zephyr_gps.latitude);
-    Message.concat(',');
-    Message.concat(zephyrRX.zephyr_gps.longitude);
-    Message.concat(',');
-    Message.concat(zephyrRX.zephyr_gps.altitude);
-    zephyrTX.setStateDetails(3, Message);
-    Message = "";
-
-    // Add binary sections to the TM
-
-    // Serialize rats_report_header into rats_report_tm.header_bytes
-    etl::span<uint8_t> header_span(rats_report_tm.header_bytes.data(), rats_report_tm.header_bytes.size());
-    etl::bit_stream_writer writer(header_span, etl::endian::big);
-    writer.write_unchecked(rats_report_header.header_size_bytes, 8);       // Set in InstrumentSetup()
-    writer.write_unchecked(rats_report_header.num_ecu_records, 16);        // Set in ratsReportAccumulate()
-    writer.write_unchecked(rats_report_header.ecu_record_size_bytes, 16);
-    writer.write_unchecked(rats_report_header.ecu_pwr_on, 1);
-    writer.write_unchecked(rats_report_header.v56, 13);
+    snprintf(log_array, LOG_ARRAY_SIZE, "%.2f,%.2f,%.2f",
+        zephyrRX.zephyr_gps.latitude, zephyrRX.zephyr_gps.longitude, zephyrRX.zephyr_gps.altitude);
+    zephyrTX.setStateDetails(3, log_array);
 
-    // Add the RATSReportHeader to the TM
-    for (uint i = 0; i < rats_report_tm.header_bytes.size(); i++) {
-        zephyrTX.addTm(rats_report_tm.header_bytes.at(i));
-    }
-
-    // Add the ECURecords to the TM
-    for (uint i = 0; i < rats_report_header.num_ecu_records; i++) {
-        for (uint j = 0; j < rats_report_header.ecu_record_size_bytes; j++) {
-            zephyrTX.addTm(rats_report_tm.records[i].at(j));
-        }
-    }
+    // Add the header and ECU records to the TM in one pass
+    zephyrTX.addTm((uint8_t*)&slot->tm, slot->length);
 
     // Send the TM!
-    zephyrTX.TM();
-
-    rats_report_header.num_ecu_records = 0;
-
-    MCB_TM_buffer_idx = 0; //reset the MCB buffer pointer
+    TM_ack_flag = NO_ACK;
+    SendTM();
+    rats_tm_frame = last_tm_frame;
+    rats_tm_ack_pending = true;
+    rats_tm_sent_millis = millis();
 
+    // The report is in the XMLWriter buffer now, release the slot
+    ratsReportReset(*slot);
 }
 
 bool StratoRATS::StartMCBMotion()
 {
     bool success = false;
+    const char* motion_name;
 
-    String msg;
+    // Snapshot the configs for this motion, so that TCs don't change them midway
+    MotionConfigSnapshot();
 
     switch (mcb_motion) {
     case MOTION_REEL_IN:
-        success = mcbComm.TX_Reel_In(retract_length, ratsConfigs.retract_velocity.Read());
-        max_reel_seconds = 60 * (retract_length / ratsConfigs.retract_velocity.Read()) + ratsConfigs.motion_timeout.Read();
-        msg = String("Reel in ") + String(retract_length,1) 
-            + " revs, timeout " + String(max_reel_seconds) 
-            + "s, velocity " + String(ratsConfigs.retract_velocity.Read(),1);
+        success = MCBCommand(MCB_REEL_IN, motion_config.length, motion_config.velocity);
+        motion_name = "Reel in";
         break;
     case MOTION_REEL_OUT:
-        success = mcbComm.TX_Reel_Out(deploy_length, ratsConfigs.deploy_velocity.Read());
-        max_reel_seconds = 60 * (deploy_length / ratsConfigs.deploy_velocity.Read()) + ratsConfigs.motion_timeout.Read();
-        msg = String("Reel out ") + String(deploy_length,1) 
-            + " revs, timeout " + String(max_reel_seconds) 
-            + "s, velocity " + String(ratsConfigs.deploy_velocity.Read(),1);
+        success = MCBCommand(MCB_REEL_OUT, motion_config.length, motion_config.velocity);
+        motion_name = "Reel out";
         break;
     case MOTION_IN_NO_LW:
-        success = mcbComm.TX_In_No_LW(retract_length, ratsConfigs.retract_velocity.Read());
-        max_reel_seconds = 60 * (retract_length / ratsConfigs.retract_velocity.Read()) + ratsConfigs.motion_timeout.Read();
-        msg = String("Reel in (no LW) ") + String(retract_length,1) 
-            + " revs, timeout " + String(max_reel_seconds) 
-            + "s, velocity " + String(ratsConfigs.retract_velocity.Read(),1);
+        success = MCBCommand(MCB_IN_NO_LW, motion_config.length, motion_config.velocity);
+        motion_name = "Reel in (no LW)";
         break;
     default:
         mcb_motion = NO_MOTION;
@@ -323,27 +832,95 @@ bool StratoRATS::StartMCBMotion()
         return false;
     }
 
-    ZephyrLogFine(msg.c_str());
-    log_nominal(msg.c_str());
+    max_reel_seconds = 60 * (motion_config.length / motion_config.velocity) + motion_config.timeout_secs;
+    snprintf(log_array, LOG_ARRAY_SIZE, "%s %.1f revs, timeout %lu s, velocity %.1f",
+        motion_name, motion_config.length, (uint32_t)max_reel_seconds, motion_config.velocity);
+    ZephyrLogFine(log_array);
+    log_nominal(log_array);
 
     return success;
 }
+
+void StratoRATS::MotionConfigSnapshot()
+{
+    bool reel_out = (MOTION_REEL_OUT == mcb_motion);
+
+    motion_config.motion = mcb_motion;
+    motion_config.length = reel_out ? deploy_length : retract_length;
+    // A profile leg may override the configured velocity and decimation
+    if (motion_velocity > 0) {
+        motion_config.velocity = motion_velocity;
+    } else {
+        motion_config.velocity = reel_out ? ratsConfigs.deploy_velocity.Read() : ratsConfigs.retract_velocity.Read();
+    }
+    motion_config.timeout_secs = ratsConfigs.motion_timeout.Read();
+    motion_config.decimation = motion_decimation_override ? motion_decimation_override : ratsConfigs.mcb_decimation.Read();
+    motion_config.flags = 0;
+    if (ratsConfigs.real_time_mcb.Read()) {
+        motion_config.flags |= MOTION_CONFIG_REAL_TIME;
+    }
+    if (reel_overlapped) {
+        motion_config.flags |= MOTION_CONFIG_OVERLAP;
+    }
+}
+
 void StratoRATS::InitMCBMotionTracking()
 {
+    mcb_ack_latency.Add(micros() - mcb_rx_micros);
+
     mcb_motion_ongoing = true;
     reel_motion_start = millis();
+    MotionHealthStart();
 
     mcb_tm_counter = 0;
-    //zephyrTX.clearTm(); // empty the TM buffer for incoming MCB motion data
+    mcb_tm_chunk = 0;
+    mcb_profile_start_epoch = now();
     MCB_TM_buffer_idx = 0;
+    reel_summary.count = 0;
+    reel_rate = 0.0f;
+    mcb_tm_full_rate_until = MCB_TM_FULL_RATE_RECORDS;
+    mcb_tm_held.clear();
+    mcb_tm_streaming = false;
+    // The motion is still tracked without the buffer, only its TM is lost
+    if (!MCBTMAcquire()) {
+        return;
+    }
     // Add the start time to the MCB TM Header if not in real-time mode
-    if (!ratsConfigs.real_time_mcb.Read()) {
-        //zephyrTX.addTm((uint32_t) now()); // as a header, add the current seconds since epoch
-        uint32_t ProfileStartEpoch  = now();
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (ProfileStartEpoch >> 24);
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (ProfileStartEpoch >> 16);
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (ProfileStartEpoch >> 8);
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (ProfileStartEpoch & 0xFF);
+    mcb_tm_streaming = !(motion_config.flags & MOTION_CONFIG_REAL_TIME);
+    if (mcb_tm_streaming) {
+        MCBTMStartChunk();
+    }
+}
+
+bool StratoRATS::MCBTMAcquire()
+{
+    // The replay only holds the arena inside DataLogReplay(), so this should not fail
+    if (!rats_arena.Acquire(ARENA_MCB_TM, MCB_TM_BUFFER_SIZE)) {
+        log_error("MCB TM buffer is in use");
+        MCB_TM_buffer_idx = 0;
+        return false;
+    }
+    return true;
+}
+
+void StratoRATS::MCBTMStartChunk()
+{
+    MCB_TM_buffer_idx = 0;
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (mcb_profile_start_epoch >> 24);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (mcb_profile_start_epoch >> 16);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (mcb_profile_start_epoch >> 8);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (mcb_profile_start_epoch & 0xFF);
+    BufferAddFloat(motion_config.velocity, MCB_TM_buffer, MCB_TM_BUFFER_SIZE, &MCB_TM_buffer_idx);
+    BufferAddFloat(motion_config.length, MCB_TM_buffer, MCB_TM_BUFFER_SIZE, &MCB_TM_buffer_idx);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (motion_config.timeout_secs >> 8);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (motion_config.timeout_secs & 0xFF);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = motion_config.decimation;
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = motion_config.flags;
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = motion_config.motion;
+
+    // The ground decoders depend on the documented header size
+    if (MCB_TM_buffer_idx != MCB_TM_CHUNK_HEADER_SIZE) {
+        log_error("MCB TM chunk header is not MCB_TM_CHUNK_HEADER_SIZE bytes");
     }
 }
 
@@ -354,65 +931,358 @@ void StratoRATS::AddMCBTM()
         log_error("invalid motion TM size");
         return;
     }
-
-    // if not in real-time mode, add the sync and time
-    if (!ratsConfigs.real_time_mcb.Read()) {
-        // sync byte        
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) 0xA5;
-                
-        // tenths of seconds since start
-        uint16_t elapsed_time = (uint16_t)((millis() - reel_motion_start) / 100);
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (elapsed_time >> 8);
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (elapsed_time & 0xFF);
+    // Records are only collected from InitMCBMotionTracking() to the last chunk
+    if (!(motion_config.flags & MOTION_CONFIG_REAL_TIME) && !mcb_tm_streaming) {
+        return;
     }
-
-    // add each byte of data to the message
-    for (int i = 0; i < MOTION_TM_SIZE; i++) {
-        MCB_TM_buffer[MCB_TM_buffer_idx++] = mcbComm.binary_rx.bin_buffer[i];
+    if (!MCBTMAcquire()) {
+        return;
     }
 
     // if real-time mode, send the TM packet
-    if (ratsConfigs.real_time_mcb.Read()) {
-        snprintf(log_array, LOG_ARRAY_SIZE, "MCB TM (Packet %u)", ++mcb_tm_counter);
+    if (motion_config.flags & MOTION_CONFIG_REAL_TIME) {
+        char reel_details[32];
+        for (int i = 0; i < MOTION_TM_SIZE; i++) {
+            MCB_TM_buffer[MCB_TM_buffer_idx++] = mcbComm.binary_rx.bin_buffer[i];
+        }
+        mcb_tm_seq = DataLogAppend(DATALOG_MCB_TM, MCB_TM_buffer, MCB_TM_buffer_idx);
+        snprintf(log_array, LOG_ARRAY_SIZE, "MCB TM (Packet %u) seq %lu", ++mcb_tm_counter, mcb_tm_seq);
         zephyrTX.addTm(MCB_TM_buffer, MCB_TM_buffer_idx);
         zephyrTX.setStateDetails(1, log_array);
         zephyrTX.setStateFlagValue(1, FINE);
-        zephyrTX.setStateDetails(2, (String("Reel: ") + String(reel_pos, 2)).c_str());
+        snprintf(reel_details, sizeof(reel_details), "Reel: %.2f", reel_pos);
+        zephyrTX.setStateDetails(2, reel_details);
         zephyrTX.setStateFlagValue(2, FINE);
         zephyrTX.setStateDetails(3, "");
         zephyrTX.setStateFlagValue(3, NOMESS);
-        zephyrTX.TM();
+        SendTM();
         log_nominal(log_array);
         //reset the MCB buffer pointer
         MCB_TM_buffer_idx = 0; 
+        return;
+    }
+
+    // tenths of seconds since start
+    uint16_t elapsed_time = (uint16_t)((millis() - reel_motion_start) / 100);
+
+    // In decimated mode, keep every Nth record outside of the full-rate windows,
+    // and summarize the rest
+    mcb_tm_counter++;
+    MCBTMCheckLimits();
+    if (motion_config.decimation > 1 && mcb_tm_counter > mcb_tm_full_rate_until) {
+        MCBTMSummarize();
+        if (mcb_tm_counter % motion_config.decimation) {
+            // The circular buffer overwrites the oldest held record when it is full
+            MCBTMHeld_t held;
+            held.elapsed_time = elapsed_time;
+            memcpy(held.data, mcbComm.binary_rx.bin_buffer, MOTION_TM_SIZE);
+            mcb_tm_held.push(held);
+            return;
+        }
+    }
+    // Older held records would be out of order after a kept one
+    mcb_tm_held.clear();
+
+    // If the buffer has reached its flush level, send it as a chunk
+    if (MCB_TM_buffer_idx >= MCB_TM_FLUSH_BYTES) {
+        SendMCBTM(FINE, "MCB motion TM chunk");
+        MCBTMStartChunk();
+    }
+
+    MCBTMFlushSummary();
+    MCBTMAddRecord(elapsed_time, mcbComm.binary_rx.bin_buffer);
+}
+
+void StratoRATS::MCBTMAddRecord(uint16_t elapsed_time, const uint8_t* data)
+{
+    // sync byte        
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) MCB_TM_RECORD_SYNC;
+            
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (elapsed_time >> 8);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (elapsed_time & 0xFF);
+
+    // add each byte of data to the message
+    for (int i = 0; i < MOTION_TM_SIZE; i++) {
+        MCB_TM_buffer[MCB_TM_buffer_idx++] = data[i];
+    }
+}
+
+void StratoRATS::MCBTMCheckLimits()
+{
+    uint32_t now_ms = millis();
+
+    if (1 == mcb_tm_counter) {
+        mcb_tm_start_pos = reel_pos;
+    } else if (now_ms != mcb_tm_prev_ms) {
+        reel_rate = 60000.0f * fabsf(reel_pos - mcb_tm_prev_pos) / (now_ms - mcb_tm_prev_ms);
+    }
+    mcb_tm_prev_pos = reel_pos;
+    mcb_tm_prev_ms = now_ms;
+
+    if (motion_config.decimation <= 1 || mcb_tm_counter <= mcb_tm_full_rate_until) {
+        return;
+    }
+
+    bool off_rate = (now_ms - reel_motion_start >= MOTION_HEALTH_GRACE_MS) && motion_config.velocity > 0
+        && fabsf(reel_rate - motion_config.velocity) > MCB_TM_RATE_BAND * motion_config.velocity;
+    bool near_end = fabsf(reel_pos - mcb_tm_start_pos) >= motion_config.length - MCB_TM_END_REVS;
+    if (off_rate || near_end) {
+        MCBTMFullRate();
+    }
+}
+
+void StratoRATS::MCBTMFullRate()
+{
+    mcb_tm_full_rate_until = mcb_tm_counter + MCB_TM_FULL_RATE_RECORDS;
+}
+
+void StratoRATS::MCBTMFlushHeld()
+{
+    if (mcb_tm_held.empty()) {
+        return;
+    }
+
+    // The summary covers the held records, and goes in front of them
+    MCBTMFlushSummary();
+    uint8_t dropped = 0;
+    while (!mcb_tm_held.empty()) {
+        if (MCB_TM_buffer_idx + MCB_TM_RECORD_HEADER_SIZE + MOTION_TM_SIZE <= MCB_TM_BUFFER_SIZE) {
+            MCBTMAddRecord(mcb_tm_held.front().elapsed_time, mcb_tm_held.front().data);
+        } else {
+            dropped++;
+        }
+        mcb_tm_held.pop();
+    }
+    if (dropped) {
+        log_error("No room for held MCB TM records");
+    }
+}
+
+void StratoRATS::MCBTMSummarize()
+{
+    if (0 == reel_summary.count) {
+        reel_summary.min_pos = reel_pos;
+        reel_summary.max_pos = reel_pos;
+        reel_summary.sum_pos = 0.0f;
+        reel_summary.min_rate = reel_rate;
+        reel_summary.max_rate = reel_rate;
+    }
+    reel_summary.count++;
+    reel_summary.min_pos = min(reel_summary.min_pos, reel_pos);
+    reel_summary.max_pos = max(reel_summary.max_pos, reel_pos);
+    reel_summary.sum_pos += reel_pos;
+    reel_summary.min_rate = min(reel_summary.min_rate, reel_rate);
+    reel_summary.max_rate = max(reel_summary.max_rate, reel_rate);
+}
+
+void StratoRATS::MCBTMFlushSummary()
+{
+    if (0 == reel_summary.count) {
+        return;
+    }
+    if (MCB_TM_buffer_idx + MCB_TM_SUMMARY_SIZE > MCB_TM_BUFFER_SIZE) {
+        log_error("No room for MCB TM summary");
+        reel_summary.count = 0;
+        return;
     }
 
+    uint16_t elapsed_time = (uint16_t)((millis() - reel_motion_start) / 100);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) MCB_TM_SUMMARY_SYNC;
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (elapsed_time >> 8);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = (uint8_t) (elapsed_time & 0xFF);
+    MCB_TM_buffer[MCB_TM_buffer_idx++] = reel_summary.count;
+    BufferAddFloat(reel_summary.min_pos, MCB_TM_buffer, MCB_TM_BUFFER_SIZE, &MCB_TM_buffer_idx);
+    BufferAddFloat(reel_summary.max_pos, MCB_TM_buffer, MCB_TM_BUFFER_SIZE, &MCB_TM_buffer_idx);
+    BufferAddFloat(reel_summary.sum_pos / reel_summary.count, MCB_TM_buffer, MCB_TM_BUFFER_SIZE, &MCB_TM_buffer_idx);
+    BufferAddFloat(reel_summary.min_rate, MCB_TM_buffer, MCB_TM_BUFFER_SIZE, &MCB_TM_buffer_idx);
+    BufferAddFloat(reel_summary.max_rate, MCB_TM_buffer, MCB_TM_BUFFER_SIZE, &MCB_TM_buffer_idx);
+
+    reel_summary.count = 0;
 }
 
 void StratoRATS::SendMCBTM(StateFlag_t state_flag, const char * message)
 {
+    // Without the buffer, the message still goes out, and there is nothing to keep
+    if (!MCBTMAcquire()) {
+        if (!mcb_motion_ongoing) {
+            mcb_tm_streaming = false;
+        }
+        mcb_tm_ack_wait = false;
+        SendMCBStatusTM(state_flag, message);
+        mcb_tm_frame = last_tm_frame;
+        return;
+    }
+
+    // A fault TM shows the records that led up to it
+    if (mcb_tm_streaming && CRIT == state_flag) {
+        MCBTMFlushHeld();
+        MCBTMFullRate();
+    }
+    // The last chunk includes the summary of the records after the last kept one
+    if (mcb_tm_streaming && !mcb_motion_ongoing) {
+        MCBTMFlushSummary();
+    }
 
     // use only the first flag to report the motion
+    mcb_tm_seq = DataLogAppend(DATALOG_MCB_TM, MCB_TM_buffer, MCB_TM_buffer_idx);
+
+    mcb_tm_details[0] = '\0';
+    if (mcb_tm_streaming) {
+        // The chunk sent after the motion has ended is the last one
+        if (!mcb_motion_ongoing) {
+            mcb_tm_streaming = false;
+        }
+        snprintf(mcb_tm_details, sizeof(mcb_tm_details), "Chunk %u%s seq %lu", mcb_tm_chunk++, mcb_tm_streaming ? "" : " (last)", mcb_tm_seq);
+    }
+    MCBTMBuild(state_flag, message);
+
+    TM_ack_flag = NO_ACK;
+    SendTM();
+    mcb_tm_frame = last_tm_frame;
+    // StratoCore's own SD copy of the TM, kept alongside the data log
+    bool write_file = true;
+#ifdef RATS_BENCH
+    write_file = !bench_active;
+#endif
+    if (write_file && !WriteFileTM("MCB")) {
+        log_error("Unable to write MCB TM to SD file");
+    }
+    if (mcb_tm_ack_wait) {
+        // Keep the TM for ResendMCBTM(), other TMs go through the same XMLWriter
+        mcb_tm_kept_length = MCB_TM_buffer_idx;
+        mcb_tm_kept_flag = state_flag;
+        strlcpy(mcb_tm_kept_message, message, sizeof(mcb_tm_kept_message));
+    }
+    MCB_TM_buffer_idx = 0; //reset the MCB buffer pointer
+    // zephyrTX has its own copy, the buffer is free once the last chunk is sent
+    if (!mcb_motion_ongoing && !mcb_tm_streaming && !mcb_tm_ack_wait) {
+        rats_arena.Release(ARENA_MCB_TM);
+    }
+}
+
+void StratoRATS::MCBTMBuild(StateFlag_t state_flag, const char * message)
+{
+    char reel_details[32];
+
     zephyrTX.clearTm();
     zephyrTX.addTm(MCB_TM_buffer,MCB_TM_buffer_idx);
     zephyrTX.setStateDetails(1, message);
     zephyrTX.setStateFlagValue(1, state_flag);
     if (state_flag == FINE) {
-        zephyrTX.setStateDetails(2, (String("Reel: ") + String(reel_pos, 2)).c_str());
+        snprintf(reel_details, sizeof(reel_details), "Reel: %.2f", reel_pos);
+        zephyrTX.setStateDetails(2, reel_details);
         zephyrTX.setStateFlagValue(2, FINE);
     } else {
         zephyrTX.setStateDetails(2, "");
         zephyrTX.setStateFlagValue(2, NOMESS);
     }
+    zephyrTX.setStateDetails(3, mcb_tm_details);
+    zephyrTX.setStateFlagValue(3, mcb_tm_details[0] ? FINE : NOMESS);
+}
+
+void StratoRATS::ResendMCBTM()
+{
+    if (!mcb_tm_ack_wait || ARENA_MCB_TM != rats_arena.Owner()) {
+        log_error("No motion TM kept to resend");
+        MCBTMAckDone();
+        return;
+    }
+
+    MCB_TM_buffer_idx = mcb_tm_kept_length;
+    MCBTMBuild(mcb_tm_kept_flag, mcb_tm_kept_message);
+    TM_ack_flag = NO_ACK;
+    SendTM();
+    mcb_tm_frame = last_tm_frame;
+    MCB_TM_buffer_idx = 0;
+    MCBTMAckDone();
+}
+
+void StratoRATS::MCBTMAckDone()
+{
+    mcb_tm_ack_wait = false;
+    if (!mcb_motion_ongoing && !mcb_tm_streaming) {
+        rats_arena.Release(ARENA_MCB_TM);
+    }
+}
+
+void StratoRATS::SendMCBStatusTM(StateFlag_t state_flag, const char * message)
+{
+    zephyrTX.clearTm();
+    zephyrTX.setStateDetails(1, message);
+    zephyrTX.setStateFlagValue(1, state_flag);
+    zephyrTX.setStateDetails(2, "");
+    zephyrTX.setStateFlagValue(2, NOMESS);
     zephyrTX.setStateDetails(3, "");
     zephyrTX.setStateFlagValue(3, NOMESS);
 
     TM_ack_flag = NO_ACK;
-    zephyrTX.TM();
-    MCB_TM_buffer_idx = 0; //reset the MCB buffer pointer
-    if (!WriteFileTM("MCB")) {
-        log_error("Unable to write MCB TM to SD file");
+    SendTM();
+}
+
+uint32_t StratoRATS::DataLogAppend(DataLogType_t type, const uint8_t* data, uint16_t length)
+{
+#ifdef RATS_BENCH
+    if (bench_active) {
+        return DATALOG_NO_SEQ;
+    }
+#endif
+    uint32_t seq = data_log.Append(type, now(), data, length);
+    if (DATALOG_NO_SEQ == seq && data_log.Ready()) {
+        log_error("Unable to write TM to SD data log");
+    }
+    return seq;
+}
+
+void StratoRATS::DataLogReplay()
+{
+    if (!replay_active || !CheckAction(ACTION_DATALOG_REPLAY)) {
+        return;
+    }
+
+    // Don't get in the way of a TM that is waiting for its ACK
+    if (mcb_tm_ack_wait || rats_tm_ack_pending) {
+        ScheduleAction(ACTION_DATALOG_REPLAY, DATALOG_REPLAY_MS);
+        return;
+    }
+
+    // A cancelled motion may end without sending its last chunk
+    if (ARENA_MCB_TM == rats_arena.Owner() && !mcb_motion_ongoing && !mcb_tm_streaming) {
+        rats_arena.Release(ARENA_MCB_TM);
+    }
+
+    // Payloads are read back into the arena, so wait for a motion TM to finish with it
+    uint8_t* replay_buffer = rats_arena.Acquire(ARENA_DATALOG_REPLAY, DATALOG_MAX_BYTES);
+    if (!replay_buffer) {
+        ScheduleAction(ACTION_DATALOG_REPLAY, DATALOG_REPLAY_MS);
+        return;
+    }
+
+    DataLogEntry_t entry;
+    if (!data_log.Read(replay_next, entry, replay_buffer, DATALOG_MAX_BYTES)) {
+        snprintf(log_array, LOG_ARRAY_SIZE, "Unable to read seq %lu from SD data log", replay_next);
+        ZephyrLogWarn(log_array);
+        log_error(log_array);
+    } else {
+        zephyrTX.clearTm();
+        zephyrTX.addTm(replay_buffer, entry.length);
+        snprintf(log_array, LOG_ARRAY_SIZE, "Replay %s seq %lu",
+            (DATALOG_RATS_REPORT == entry.type) ? "RATSReport" : "MCB TM", entry.seq);
+        zephyrTX.setStateDetails(1, log_array);
+        zephyrTX.setStateFlagValue(1, FINE);
+        snprintf(log_array, LOG_ARRAY_SIZE, "Logged at %lu", entry.epoch);
+        zephyrTX.setStateDetails(2, log_array);
+        zephyrTX.setStateFlagValue(2, FINE);
+        zephyrTX.setStateFlagValue(3, NOMESS);
+        SendTM();
+    }
+    rats_arena.Release(ARENA_DATALOG_REPLAY);
+
+    if (replay_next++ >= replay_last) {
+        replay_active = false;
+        log_nominal("SD data log replay complete");
+        return;
     }
+    ScheduleAction(ACTION_DATALOG_REPLAY, DATALOG_REPLAY_MS);
 }
 
 void StratoRATS::SendMCBEEPROM()
@@ -429,8 +1299,7 @@ void StratoRATS::SendMCBEEPROM()
 
     // send as TM
     TM_ack_flag = NO_ACK;
-    zephyrTX.TM();
-    MCB_TM_buffer_idx = 0; //reset the MCB buffer pointer
+    SendTM();
 
     log_nominal("MCB EEPROM TM");
 }
@@ -448,24 +1317,134 @@ void StratoRATS::SendRATSEEPROM()
     // prepare the TM buffer
     zephyrTX.clearTm();
     zephyrTX.addTm(mcbComm.binary_rx.bin_buffer, mcbComm.binary_rx.bin_length);
+    // The loop stats follow the EEPROM image, in the RATSGETLOOPSTATS layout
+    AddLoopStatsTM();
 
     // use only the first flag to preface the contents
-    zephyrTX.setStateDetails(1, String("RATS EEPROM data; length ") + String(mcbComm.binary_rx.bin_length));
+    snprintf(log_array, LOG_ARRAY_SIZE, "RATS EEPROM data; length %u, loop stats follow", (unsigned)mcbComm.binary_rx.bin_length);
+    zephyrTX.setStateDetails(1, log_array);
     zephyrTX.setStateFlagValue(1, FINE);
-    zephyrTX.setStateFlagValue(2, NOMESS);
-    zephyrTX.setStateFlagValue(3, NOMESS);
+
+    // Serial buffer usage: RX high-water, TX minimum free, RX full count
+    snprintf(log_array, LOG_ARRAY_SIZE, "Zephyr serial rx:%u/%u tx free:%u/%u full:%lu tx max:%lu blk:%lu",
+        zephyr_serial_stats.rx_high_water, zephyr_serial_stats.rx_size,
+        zephyr_serial_stats.tx_low_free, zephyr_serial_stats.tx_size, zephyr_serial_stats.rx_full_count,
+        zephyr_tx.high_water, zephyr_tx.blocked_count);
+    zephyrTX.setStateDetails(2, log_array);
+    zephyrTX.setStateFlagValue(2, FINE);
+    snprintf(log_array, LOG_ARRAY_SIZE, "MCB serial rx:%u/%u tx free:%u/%u full:%lu",
+        mcb_serial_stats.rx_high_water, mcb_serial_stats.rx_size,
+        mcb_serial_stats.tx_low_free, mcb_serial_stats.tx_size, mcb_serial_stats.rx_full_count);
+    zephyrTX.setStateDetails(3, log_array);
+    zephyrTX.setStateFlagValue(3, FINE);
 
     // send as TM
     TM_ack_flag = NO_ACK;
-    zephyrTX.TM();
-    MCB_TM_buffer_idx = 0; //reset the MCB buffer pointer
+    SendTM();
+
+    ResetLoopStats();
 
     log_nominal("Sent RATS EEPROM as TM");
 }
 
-    uint32_t StratoRATS::lora_count_check(bool reset) {
-        if (reset) {
-            lora_count = total_lora_count;;
-        } 
-        return total_lora_count - lora_count;
+void StratoRATS::SendLoopStats()
+{
+    zephyrTX.clearTm();
+    AddLoopStatsTM();
+
+    zephyrTX.setStateDetails(1, "RATS loop stats");
+    zephyrTX.setStateFlagValue(1, FINE);
+    snprintf(log_array, LOG_ARRAY_SIZE, "Tick max:%lu us overruns:%lu missed:%lu allocs:%lu/%lu stale:%lu",
+        loop_profiler.MaxUs(STAGE_TICK), loop_profiler.overrun_ticks, (uint32_t)loop_profiler.missed_ticks,
+        loop_profiler.alloc_loops, loop_profiler.loop_allocs, stale_actions);
+    zephyrTX.setStateDetails(2, log_array);
+    zephyrTX.setStateFlagValue(2, FINE);
+    zephyrTX.setStateFlagValue(3, NOMESS);
+
+    // send as TM
+    TM_ack_flag = NO_ACK;
+    SendTM();
+
+    ResetLoopStats();
+
+    log_nominal("Sent RATS loop stats as TM");
+}
+
+void StratoRATS::AddLoopStatsTM()
+{
+    // For each stage: count, min, max, mean (us), and the histogram
+    for (uint8_t i = 0; i < NUM_LOOP_STAGES; i++) {
+        LoopStage_t stage = (LoopStage_t) i;
+        zephyrTX.addTm((uint32_t) loop_profiler.stats[i].count);
+        zephyrTX.addTm((uint32_t) loop_profiler.MinUs(stage));
+        zephyrTX.addTm((uint32_t) loop_profiler.MaxUs(stage));
+        zephyrTX.addTm((uint32_t) loop_profiler.MeanUs(stage));
+        for (uint8_t j = 0; j < LOOP_HIST_BINS; j++) {
+            zephyrTX.addTm((uint16_t) loop_profiler.stats[i].hist[j]);
+        }
+    }
+    zephyrTX.addTm((uint32_t) loop_profiler.overrun_ticks);
+    zephyrTX.addTm((uint32_t) loop_profiler.missed_ticks);
+    zephyrTX.addTm((uint32_t) loop_profiler.alloc_loops);
+    zephyrTX.addTm((uint32_t) loop_profiler.loop_allocs);
+
+    // For each MCB command, in mcb_cmd_table order: sent, acked, retries, failures,
+    // max and mean round-trip time (us)
+    for (uint8_t i = 0; i < NUM_MCB_COMMANDS; i++) {
+        MCBCommandStats_t& stats = mcb_cmd_stats[i];
+        zephyrTX.addTm((uint16_t) stats.sent);
+        zephyrTX.addTm((uint16_t) stats.acked);
+        zephyrTX.addTm((uint16_t) stats.retries);
+        zephyrTX.addTm((uint16_t) stats.failures);
+        zephyrTX.addTm((uint32_t) stats.max_us);
+        zephyrTX.addTm((uint32_t) (stats.acked ? stats.total_us / stats.acked : 0));
+    }
+
+    // ECU energy use: total on-time (s, including the current on period) and records
+    uint32_t ecu_on_ms = ecu_on_total_ms + (digitalRead(ECU_PWR_EN) ? millis() - ecu_on_millis : 0);
+    zephyrTX.addTm((uint32_t) (ecu_on_ms / 1000));
+    zephyrTX.addTm((uint32_t) ecu_records);
+
+    // Low power wake-up latency for each event: count, max and mean (us)
+    for (uint8_t i = 0; i < NUM_RATS_EVENTS; i++) {
+        zephyrTX.addTm((uint32_t) wake_latency[i].count);
+        zephyrTX.addTm((uint32_t) wake_latency[i].max_us);
+        zephyrTX.addTm((uint32_t) wake_latency[i].Mean());
     }
+
+    // Scheduled actions: stale unchecked total, schedule drops and high water mark,
+    // then the stale count of each action
+    zephyrTX.addTm((uint32_t) stale_actions);
+    zephyrTX.addTm((uint32_t) rats_scheduler.dropped);
+    zephyrTX.addTm((uint16_t) rats_scheduler.high_water);
+    for (uint8_t i = 0; i < NUM_ACTIONS; i++) {
+        zephyrTX.addTm((uint16_t) stale_action_counts[i]);
+    }
+
+    // For each TC, in tc_table order: count, rejected, max and mean handling time (us)
+    for (uint8_t i = 0; i < NUM_RATS_TCS; i++) {
+        TCStats_t& stats = tc_stats[i];
+        zephyrTX.addTm((uint16_t) stats.count);
+        zephyrTX.addTm((uint16_t) stats.rejected);
+        zephyrTX.addTm((uint32_t) stats.max_us);
+        zephyrTX.addTm((uint32_t) (stats.count ? stats.total_us / stats.count : 0));
+    }
+}
+
+void StratoRATS::ResetLoopStats()
+{
+    loop_profiler.Reset();
+    for (uint8_t i = 0; i < NUM_RATS_TCS; i++) {
+        tc_stats[i] = TCStats_t();
+    }
+    for (uint8_t i = 0; i < NUM_MCB_COMMANDS; i++) {
+        mcb_cmd_stats[i] = MCBCommandStats_t();
+    }
+    for (uint8_t i = 0; i < NUM_RATS_EVENTS; i++) {
+        wake_latency[i] = LatencyStats_t();
+    }
+    stale_actions = 0;
+    memset(stale_action_counts, 0, sizeof(stale_action_counts));
+    rats_scheduler.dropped = 0;
+    rats_scheduler.high_water = rats_scheduler.Pending();
+}
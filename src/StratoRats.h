@@ -5,26 +5,55 @@
 #include "StratoCore.h"
 #include "RATSHardware.h"
 #include "RATSConfigs.h"
+#include "ZephyrTXStream.h"
+#include "LoopProfiler.h"
+#include "RATSLog.h"
+#include "RATSScheduler.h"
+#include "RATSDataLog.h"
+#include "RATSArena.h"
 #include "MCBComm.h"
 #include "ECULoRa.h"
 #include "ECUReport.h"
 #include "etl/bit_stream.h"
 #include "etl/array.h"
+#include "etl/queue.h"
+#include "etl/circular_buffer.h"
+
+// defines loop period in 0.1s
+#define LOOP_TENTHS     5
 
 // Set this true to disable some error checking and logging during development testing.
 #define DISABLE_DEVEL_ERROR_CHECKING false
 
-#define EXTRA_LOGGING false
+// A RATSReport is sent when ratsConfigs.report_records ECU records have been
+// received, or when ratsConfigs.report_period seconds have elapsed.
+// NUM_ECU_REPORTS sizes the report buffers, for raw ECU records.
+#define NUM_ECU_REPORTS 180
 
-// RATSReport reporting period, when scheduled by ACTION_RATS_REPORT.
-#define RATS_REPORT_PERIOD_SECS 300
+// Adaptive RATS report cadence (ratsConfigs.report_adaptive). The batch size grows
+// when the RATS report TM ACK is slower than RATS_ADAPT_BUSY_MS or is NAKed, and
+// shrinks back towards ratsConfigs.report_records when the ACK is faster than 
+// RATS_ADAPT_FAST_MS. The batch grows to at most RATS_ADAPT_MAX_FACTOR times the
+// configured size, and never past NUM_ECU_REPORTS. The report period is scaled
+// with the batch size.
+#define RATS_ADAPT_BUSY_MS      5000
+#define RATS_ADAPT_FAST_MS      1000
+#define RATS_ADAPT_MAX_FACTOR   4
 
-// Send a RATSReport when NUM_ECU_REPORTS have been received.
-// But if RATS_REPORT_PERIOD_SECS has elapsed, the report will be sent regardless.
-#define NUM_ECU_REPORTS 180
+// Number of RATS report buffers. One slot accumulates ECU records while
+// sealed slots wait for transmission.
+#define RATS_REPORT_SLOTS 2
+
+// What ratsReportAccumulate() does when every slot is sealed and waiting to be sent:
+// REPORT_FULL_DROP_NEWEST drops the incoming records,
+// REPORT_FULL_OVERWRITE_OLDEST discards the oldest sealed report and reuses its slot.
+#define RATS_REPORT_FULL_POLICY REPORT_FULL_DROP_NEWEST
+
+// Size of the changed-byte bitmap in front of each REPORT_FORMAT_CHANGED_BYTES record
+#define ECU_CHANGED_BITMAP_BYTES ((ECU_REPORT_SIZE_BYTES+7)/8)
 
 // RATS_REPORT_MAX_BYTES is the maximum size of a RATS report in bytes. 
-#define RATS_REPORT_MAX_BYTES (RATS_HEADER_SIZE_BYTES+(NUM_ECU_REPORTS+1)*ECU_REPORT_SIZE_BYTES)
+#define RATS_REPORT_MAX_BYTES (RATS_HEADER_SIZE_BYTES+NUM_ECU_REPORTS*ECU_REPORT_SIZE_BYTES)
 
 // Verify that a RATS report will fit in the TM message buffer.
 #if RATS_REPORT_MAX_BYTES > 8192
@@ -45,28 +74,100 @@
 // Our instrument name
 #define INSTRUMENT      RATS
 
-// Number of LoRa messages to wait for before moving on
-#define LORA_MSG_COUNT  3
-// Seconds to wait for all LoRa messages to be received during warmup
+// Seconds to wait for ratsConfigs.warmup_msgs LoRa messages during warmup
 #define LORA_WARMUP_MSG_TIMEOUT 15
+// Number of LoRa frames that can be queued by the LoRa ISR before LoRaRX() drains them
+#define LORA_RX_QUEUE_SIZE 8
+
+// The ECU config downlink is sent after the next ECU uplink, so the second uplink
+// after ECUConfigSend() shows that it went out. The ECU does not acknowledge it.
+#define ECU_CONFIG_SENT_MSGS 2
+// Set true to send ECU config as binary (ECU_CONFIG_BINARY_ID, parameter mask,
+// float per set parameter) instead of JSON. The ECU firmware must support it.
+#define ECU_CONFIG_BINARY false
+#define ECU_CONFIG_BINARY_ID 0xEC
 
 #define MCB_SERIAL_BUFFER_SIZE    4096
 
 // Buffers for msg reception and transmission to/from Zephyr. Should be large enough
 // to hold a complete TM, some of which which will contain the measurement data.
+// A TM that does not fit in the room left still blocks in the write (ZephyrTXStream.h).
 #define ZEPHYR_SERIAL_BUFFER_SIZE (2*8192)
 
-// Number of loops before a flag becomes stale and is reset
+// Number of loops before a flag becomes stale and is reset. Stale flags are
+// counted in stale_actions and logged.
 #define FLAG_STALE      3
-//
+// Resend timeouts are in seconds
 #define MCB_RESEND_TIMEOUT      10
 
+// The size of the buffer that collects MCB motion data for the MCB TM. Once
+// MCB_TM_FLUSH_BYTES have been collected, the buffer is sent as a TM chunk and
+// motion data collection continues in a new chunk. The flush level leaves room
+// in the TM for the XML overhead, and for the record that triggers the flush.
+#define MCB_TM_BUFFER_SIZE 8192
+#define MCB_TM_FLUSH_BYTES 6144
+// Sync byte and elapsed time in front of each motion record
+#define MCB_TM_RECORD_HEADER_SIZE 3
+#define MCB_TM_RECORD_SYNC 0xA5
+// In decimated MCB TM mode (ratsConfigs.mcb_decimation > 1) each kept motion record
+// is preceded by a summary of the records since the last kept one: sync, elapsed
+// time (0.1 s), sample count, then the min, max and mean reel position (revs) and the
+// min and max reel rate between records (revs/min), as floats.
+#define MCB_TM_SUMMARY_SYNC 0x5A
+#define MCB_TM_SUMMARY_SIZE (1+2+1+5*4)
+// Records are kept at full rate for MCB_TM_FULL_RATE_RECORDS after the motion start,
+// and after each of these conditions:
+//  - the reel rate is off the commanded velocity by more than MCB_TM_RATE_BAND,
+//    once MOTION_HEALTH_GRACE_MS have passed
+//  - the reel is within MCB_TM_END_REVS of the end of the commanded length
+//  - a fault (a CRIT motion TM); the last MCB_TM_HELD_RECORDS records that were
+//    decimated away are added first, so the TM shows the lead-up to the fault
+// Held records are sent as plain motion records, after the summary that covers them.
+#define MCB_TM_FULL_RATE_RECORDS 20
+#define MCB_TM_RATE_BAND        0.25f
+#define MCB_TM_END_REVS         2.0f
+#define MCB_TM_HELD_RECORDS     8
+// The reel position (float, revs) in the MCB_MOTION_TM record. Only the reel
+// position is read, the rest of the record is passed through to the TM.
+#define MCB_MOTION_REEL_POS_OFFSET 21
+static_assert(MCB_MOTION_REEL_POS_OFFSET + sizeof(float) <= MOTION_TM_SIZE, "The reel position is outside MOTION_TM_SIZE");
+static_assert(MCB_TM_FLUSH_BYTES + MCB_TM_SUMMARY_SIZE + MCB_TM_RECORD_HEADER_SIZE + MOTION_TM_SIZE <= MCB_TM_BUFFER_SIZE,
+    "MCB_TM_FLUSH_BYTES leaves no room for the next record");
+// Each non-real-time MCB TM chunk starts with the profile start epoch, then the
+// MotionConfig_t in effect: velocity, length (floats), timeout (s, 16 bits),
+// decimation, MOTION_CONFIG_* flags and the MCBMotion_t. The epoch and timeout
+// are big-endian, the floats little-endian (BufferAddFloat()).
+// Format change: the chunk header used to be the 4 byte epoch only. Ground
+// decoders must skip MCB_TM_CHUNK_HEADER_SIZE (17) bytes before the first
+// record sync byte. Real-time MCB TMs have no chunk header.
+#define MCB_TM_CHUNK_HEADER_SIZE (4+4+4+2+1+1+1)
+static_assert(MCB_TM_CHUNK_HEADER_SIZE < MCB_TM_FLUSH_BYTES, "MCB TM chunk header leaves no room for records");
+#define MOTION_CONFIG_REAL_TIME 0x01
+#define MOTION_CONFIG_OVERLAP   0x02
+
+// Motion health monitor (MotionHealth.cpp). The checks start MOTION_HEALTH_GRACE_MS
+// after the motion start, overspeed is measured over MOTION_HEALTH_WINDOW_MS, and
+// the reel has to move MOTION_STALL_MIN_REVS within ratsConfigs.motion_stall_secs.
+#define MOTION_HEALTH_GRACE_MS  10000
+#define MOTION_HEALTH_WINDOW_MS 3000
+#define MOTION_STALL_MIN_REVS   0.1f
+
 // The size of a buffer used for binary transfers between RATS and MCB.
 #define MCB_BINARY_BUFFER_SIZE MAX_MCB_BINARY
 #define HEARTBEAT_LED_PIN	3
 
 #define ZEPHYR_RESEND_TIMEOUT   60
 
+// Spacing of the TMs sent by a RATSREPLAY, and the most records one TC can request
+#define DATALOG_REPLAY_MS       2000
+#define DATALOG_REPLAY_MAX      100
+// The largest payload in the SD data log
+#define DATALOG_MAX_BYTES       ((RATS_REPORT_MAX_BYTES > MCB_TM_BUFFER_SIZE) ? RATS_REPORT_MAX_BYTES : MCB_TM_BUFFER_SIZE)
+
+// The shared buffer (RATSArena.h) for the MCB TM and RATSREPLAY, in RAM2
+#define RATS_ARENA_SIZE         DATALOG_MAX_BYTES
+static_assert(RATS_ARENA_SIZE >= MCB_TM_BUFFER_SIZE, "The arena must hold MCB_TM_buffer");
+
     // Actions
 enum ScheduleAction_t : uint8_t {
     NO_ACTION = NO_SCHEDULED_ACTION,
@@ -79,7 +180,6 @@ enum ScheduleAction_t : uint8_t {
 
     ACTION_START_TELEMETRY,
     ACTION_GPS_WAIT_MSG,
-    ACTION_LORA_COUNT_MSGS,
     ACTION_RATS_REPORT,
     ACTION_REEL_OUT,
     ACTION_REEL_IN,
@@ -88,6 +188,13 @@ enum ScheduleAction_t : uint8_t {
 
     ACTION_MOTION_STOP,
     ACTION_MOTION_TIMEOUT,
+    ACTION_MOTION_HEALTH,
+
+    ACTION_PROFILE_START,
+    ACTION_PROFILE_DWELL,
+
+    ACTION_DATALOG_REPLAY,
+    ACTION_DUTY_ON,
 
     NUM_ACTIONS
 };
@@ -99,6 +206,35 @@ enum MCBMotion_t : uint8_t {
     MOTION_IN_NO_LW
 };
 
+// The configs in effect for one reel motion, taken by StartMCBMotion(). The motion
+// code reads these instead of ratsConfigs, so a TC can't change them midway.
+struct MotionConfig_t {
+    float velocity;         // revs/min, after any profile leg override
+    float length;           // revs
+    uint16_t timeout_secs;  // ratsConfigs.motion_timeout
+    uint8_t decimation;     // MCB TM decimation, after any profile leg override
+    uint8_t flags;          // MOTION_CONFIG_*
+    MCBMotion_t motion;
+};
+
+// RATS report record formats, selected by ratsConfigs.data_proc_method (RATSDATAPROCTYPE TC).
+// The RATS report header changed_bytes bit is set for REPORT_FORMAT_CHANGED_BYTES, and
+// is 0 for plain records, so a plain report is unchanged from the original format.
+enum RATSReportFormat_t : uint8_t {
+    // ECU records are sent as-is, ECU_REPORT_SIZE_BYTES each
+    REPORT_FORMAT_RAW = 1,
+    // Changed-byte compression, not a field delta: each record is an
+    // ECU_CHANGED_BITMAP_BYTES bitmap (MSB first) flagging the bytes that differ
+    // from the previous record, followed by the new values of those bytes.
+    // The first record of a report is compared against an all-zero record.
+    REPORT_FORMAT_CHANGED_BYTES = 2
+};
+
+enum ReportFullPolicy_t : uint8_t {
+    REPORT_FULL_DROP_NEWEST,
+    REPORT_FULL_OVERWRITE_OLDEST
+};
+
 enum WarmupStatus_t : uint8_t {
     WARMUP_NOT_STARTED,
     WARMUP_INPROCESS,
@@ -106,9 +242,224 @@ enum WarmupStatus_t : uint8_t {
     WARMUP_COMPLETE
 };
 
-class StratoRATS : public StratoCore {
-#define RATS_HEADER_SIZE_BITS (8+16+16+1+13)
-#define RATS_HEADER_SIZE_BYTES 7
+// ECU parameters that can be set over LoRa. The JSON keys are in ECUConfig.cpp.
+enum ECUConfigParam_t : uint8_t {
+    ECU_CONFIG_TEMPC,
+    ECU_CONFIG_LORA_SF,
+    ECU_CONFIG_LORA_BW,
+    ECU_CONFIG_LORA_TXP,
+    NUM_ECU_CONFIG_PARAMS
+};
+// The parameters of a LoRa link rate change
+#define LORA_LINK_CONFIG_MASK ((1 << ECU_CONFIG_LORA_SF) | (1 << ECU_CONFIG_LORA_BW) | (1 << ECU_CONFIG_LORA_TXP))
+
+// Events posted to the main loop by the ISRs and serial event handlers.
+// The I/O routers run as soon as their event is posted, the mode state 
+// machines only run on EVENT_TICK (every LOOP_TENTHS).
+enum RATSEvent_t : uint8_t {
+    EVENT_TICK      = 0x01,
+    EVENT_ZEPHYR_RX = 0x02,
+    EVENT_MCB_RX    = 0x04,
+    EVENT_LORA_RX   = 0x08
+};
+#define NUM_RATS_EVENTS 4
+
+// In low power mode the core clock is scaled to LOW_POWER_CPU_HZ and the core sleeps (WFI)
+// between interrupts. At 150 MHz the IPG bus clock is unchanged, so Timer1 keeps its period.
+#define LOW_POWER_CPU_HZ    150000000
+
+// Serial buffer usage for one port, sampled in the main loop. 
+// Used to size ZEPHYR_SERIAL_BUFFER_SIZE and MCB_SERIAL_BUFFER_SIZE.
+struct SerialBufferStats_t {
+    // The memory added to the port buffers, 0 if none
+    uint16_t rx_size = 0;
+    uint16_t tx_size = 0;
+    // Maximum bytes waiting in the RX buffer
+    uint16_t rx_high_water = 0;
+    // Minimum free space in the TX buffer
+    uint16_t tx_low_free = 0xFFFF;
+    // Number of samples with the RX buffer full, when incoming data may have been lost
+    uint32_t rx_full_count = 0;
+
+    template <class Port> void Sample(Port& port) {
+        uint16_t rx = port.available();
+        uint16_t tx_free = port.availableForWrite();
+        if (rx > rx_high_water) {
+            rx_high_water = rx;
+        }
+        if (tx_free < tx_low_free) {
+            tx_low_free = tx_free;
+        }
+        if (rx_size && rx >= rx_size) {
+            rx_full_count++;
+        }
+    }
+};
+
+// A received LoRa frame, with the radio statistics captured when it was read.
+struct LoRaFrame_t {
+    ECULoRaMsg_t msg;
+    int16_t rssi;
+    float snr;
+    int32_t ferr;
+};
+
+// LoRa link quality and adaptive rate (LoRaLink.cpp)
+// RSSI and SNR are averaged over about LORA_LINK_AVERAGE frames, loss over about LORA_LINK_WINDOW
+#define LORA_LINK_AVERAGE           8
+#define LORA_LINK_WINDOW            64
+// Frames at a rate before it is changed again
+#define LORA_LINK_MIN_FRAMES        30
+// SNR margin over the demodulation floor (dB) to step to a slower / faster rate
+#define LORA_LINK_MARGIN_LOW_DB     3.0f
+#define LORA_LINK_MARGIN_HIGH_DB    10.0f
+// Loss rates to step to a slower rate / allow a faster rate
+#define LORA_LINK_LOSS_HIGH         0.10f
+#define LORA_LINK_LOSS_LOW          0.02f
+// ECU TX power steps and lower limit, dBm
+#define LORA_LINK_TXP_STEP_DB       3
+#define LORA_LINK_MIN_TXP           5
+// Time after the uplink that carried a rate change before the RATS radio follows
+#define LORA_LINK_SWITCH_DELAY_MS   500
+// Time without frames at a new rate before returning to the boot rate
+#define LORA_LINK_FALLBACK_MS       15000
+// ECU requirement: the time the ECU waits for the confirmation downlink on a
+// new rate before it returns to the boot rate. Shorter than LORA_LINK_FALLBACK_MS.
+#define LORA_LINK_ECU_CONFIRM_MS    10000
+static_assert(LORA_LINK_ECU_CONFIRM_MS < LORA_LINK_FALLBACK_MS, "the ECU must fall back before RATS");
+
+// Rolling LoRa link stats
+struct LoRaLinkStats_t {
+    float rssi = 0.0f;
+    float snr = 0.0f;
+    // Frames received and lost in the loss window
+    uint16_t window_rx = 0;
+    uint16_t window_lost = 0;
+    // Frames since the last rate change
+    uint32_t frames = 0;
+
+    // Add a received frame, and the radio losses before it
+    void Add(int16_t frame_rssi, float frame_snr, uint32_t lost);
+    float LossRate() const {
+        return (window_rx + window_lost) ? (float)window_lost / (window_rx + window_lost) : 0.0f;
+    }
+};
+
+// Simple latency accumulator, all values in microseconds.
+struct LatencyStats_t {
+    uint32_t count = 0;
+    uint32_t last_us = 0;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;
+
+    void Add(uint32_t us) {
+        count++;
+        last_us = us;
+        total_us += us;
+        if (us > max_us) {
+            max_us = us;
+        }
+    }
+    uint32_t Mean() const { return count ? (uint32_t)(total_us / count) : 0; }
+};
+
+// TC dispatch (TCHandler.cpp). Each TC has an entry in StratoRATS::tc_table
+// with its handler and the rules for when it is accepted.
+// The extended TCs need Telecommand_t ids and ratsParam fields that the pinned
+// StrateoleXML does not have yet, so they are only built with RATS_EXTENDED_TCS
+// (the rats_extended_tcs env). Without them, their configs keep the values
+// stored in the EEPROM, or the defaults.
+#ifdef RATS_EXTENDED_TCS
+#define NUM_RATS_EXTENDED_TCS   11
+#else
+#define NUM_RATS_EXTENDED_TCS   0
+#endif
+#define NUM_RATS_TCS        (26 + NUM_RATS_EXTENDED_TCS)
+// TC ids below this are looked up through an index, others are searched for
+#define TC_INDEX_SIZE       256
+// TCEntry_t modes is a mask of TC_MODE(InstMode_t)
+#define TC_MODE(mode)       (1 << (mode))
+#define TC_ALL_MODES        0xFF
+// TCEntry_t substate is the flight substate the TC requires, or TC_ANY_SUBSTATE
+#define TC_ANY_SUBSTATE     0xFF
+// TCEntry_t flags
+#define TC_NO_MOTION        0x01    // rejected while an MCB motion is ongoing
+#define TC_NO_PROFILE       0x02    // rejected while a profile is running
+
+class StratoRATS;
+typedef bool (StratoRATS::*TCFunc_t)();
+
+struct TCEntry_t {
+    Telecommand_t tc;
+    const char* name;
+    TCFunc_t handler;
+    uint8_t modes;
+    uint8_t substate;
+    uint8_t flags;
+    // The summary log level if the handler succeeds
+    LOG_LEVEL_t level;
+};
+
+// Per-TC handling statistics
+struct TCStats_t {
+    uint16_t count;
+    uint16_t rejected;
+    uint32_t max_us;
+    uint32_t total_us;
+};
+
+// Outbound MCB command queue (MCBQueue.cpp). The ACK timeout doubles for each retry.
+// Commands that are not retried are held in flight for MCB_NO_RETRY_HOLD_MS.
+#define NUM_MCB_COMMANDS        16
+#define MCB_QUEUE_SIZE          8
+#define MCB_MAX_IN_FLIGHT       4
+#define MCB_ACK_TIMEOUT_MS      500
+#define MCB_MAX_RETRIES         3
+#define MCB_NO_RETRY_HOLD_MS    (MCB_RESEND_TIMEOUT * 1000UL)
+
+struct MCBCommandEntry_t {
+    uint8_t msg_id;
+    const char* name;
+    uint8_t num_params;
+    // Only idempotent commands are resent by the queue
+    bool retry;
+};
+
+// Per MCB command queue statistics, reported by SendLoopStats()
+struct MCBCommandStats_t {
+    uint16_t sent;
+    uint16_t acked;
+    uint16_t retries;
+    uint16_t failures;      // dropped unACKed, or the queue was full
+    uint32_t max_us;        // round-trip time from the last send to the ACK
+    uint32_t total_us;
+};
+
+struct MCBQueued_t {
+    uint8_t command;        // mcb_cmd_table index
+    float params[2];
+    uint8_t tries;          // times sent
+    bool in_flight;
+    bool urgent;
+    uint32_t sent_ms;
+    uint32_t sent_us;
+};
+
+// Holds the Zephyr TX stream ahead of the StratoCore base class, so that the
+// stream is constructed before StratoCore is given its address.
+struct ZephyrTXHolder {
+    ZephyrTXHolder(Stream* port) : zephyr_tx(port) { }
+    // All Zephyr output goes through this stream
+    ZephyrTXStream zephyr_tx;
+};
+
+class StratoRATS : private ZephyrTXHolder, public StratoCore {
+// The first 7 bytes are the original header, with the record format in its
+// 2 spare bits; the LoRa link stats follow. This changes the RATS report TM
+// format: the header is now 11 bytes, so ground decoders must skip
+// header_size_bytes, not a fixed 7 bytes, to find the ECU records.
+#define RATS_HEADER_SIZE_BITS (8+16+16+1+13+1+1 + 8+8+8+4+4)
+#define RATS_HEADER_SIZE_BYTES ((RATS_HEADER_SIZE_BITS+7)/8)
     struct RATSReportHeader_t {
         uint8_t header_size_bytes : 8;
         // The number of ECU records in the report. There may be zero records 
@@ -119,19 +470,45 @@ class StratoRATS : public StratoCore {
         uint8_t ecu_pwr_on : 1;
         // The 56V voltage in 0.01V units (0-8191 : 0.00V to 81.91V)
         uint16_t v56 : 13;
+        // Set if the ECU records are in REPORT_FORMAT_CHANGED_BYTES
+        uint8_t changed_bytes : 1;
+        // Unused, 0
+        uint8_t spare : 1;
+        // LoRa link stats (LoRaLink.cpp): -RSSI in dBm, SNR in 0.25 dB units,
+        // loss rate in 0.5% units, SF, and bandwidth in 125 kHz units
+        uint8_t link_rssi : 8;
+        int8_t link_snr : 8;
+        uint8_t link_loss : 8;
+        uint8_t link_sf : 4;
+        uint8_t link_bw : 4;
     };
     
-    // A byte array to hold the serialized RATS report header.
-    typedef etl::array<uint8_t, RATS_HEADER_SIZE_BYTES> RATSReportHeaderBytes_t;
-
-    // The RATS report serialized bytes are collected here. But note that each item
-    // will need to be added to the TM buffer individually.
+    // The RATS report is staged here exactly as it is sent in the TM binary section:
+    // the serialized header, followed by the ECU records. ECU records are written in 
+    // place as they arrive, the header is written when the report is sealed, and the
+    // whole report is handed to zephyrTX as one contiguous span.
     struct RATSReportTM_t {
-        // The RATS report header
-        RATSReportHeaderBytes_t header_bytes;
-        // The ECU report data. There may be zero records if the ECU was not powered on.
-        // Extra space just in case?
-        ECUReportBytes_t records[1+NUM_ECU_REPORTS];
+        // The serialized RATS report header
+        uint8_t header_bytes[RATS_HEADER_SIZE_BYTES];
+        // The ECU report data, encoded according to the header changed_bytes bit.
+        // There may be zero records if the ECU was not powered on.
+        uint8_t records[NUM_ECU_REPORTS*ECU_REPORT_SIZE_BYTES];
+    };
+    static_assert(sizeof(RATSReportTM_t) == RATS_REPORT_MAX_BYTES, "RATSReportTM_t must be contiguous");
+
+    // One RATS report buffer. A slot is filled until it is sealed, and
+    // released once its TM has been sent.
+    struct RATSReportSlot_t {
+        RATSReportHeader_t header;
+        RATSReportTM_t tm;
+        // Set when the header has been serialized and the slot is waiting for TX
+        bool sealed;
+        // Length of the sealed report in bytes
+        uint16_t length;
+        // Bytes of tm.records in use
+        uint16_t bytes_used;
+        // The last record added, used by REPORT_FORMAT_CHANGED_BYTES
+        uint8_t prev_record[ECU_REPORT_SIZE_BYTES];
     };
 public:
     StratoRATS();
@@ -146,10 +523,77 @@ public:
     // called in each main loop
     void RunMCBRouter();
 
+    // Log the RAM budget per subsystem (MemoryBudget.cpp)
+    void MemoryReport();
+
+#ifdef RATS_BENCH
+    // Run the handler benchmarks (in Bench.cpp)
+    void Bench();
+    // Clear the stats and link state left by the benchmarks
+    void BenchCleanup();
+    // Set while the benchmarks run: nothing goes to the SD data log, and the
+    // report format comes from bench_format instead of ratsConfigs
+    bool bench_active = false;
+    uint8_t bench_format = REPORT_FORMAT_RAW;
+#endif
+
+    // *** Event driven loop support (see StratoCore_RATS.ino) ***
+    // Post an event. Safe to call from an ISR.
+    void PostEvent(uint8_t event);
+    // Fetch and clear all pending events. Returns 0 if there are none.
+    uint8_t TakeEvents();
+    // Run the StratoCore Zephyr router, and track the TC-to-ACK latency.
+    void RunZephyrRouter();
+    // The main loop stage profiler
+    LoopProfiler& Profiler() { return loop_profiler; }
+    // Write one deferred log record to the debug log. Call while the loop is idle.
+    void DrainLog() { rats_log.Drain(); }
+    // *** Low power mode (LowPower.cpp) ***
+    // Set while the main loop sleeps between events
+    bool Sleeping() const { return lp_sleeping; }
+    // Sleep the core until the next interrupt. Returns at once unless sleeping, or
+    // if there is output to drain or input waiting.
+    void LowPowerIdle();
+    // Record the wake-up latency of the events taken by the main loop
+    void LowPowerWake(uint8_t events);
+    // Read the radio and drain the LoRa RX queue. Called on EVENT_LORA_RX and in InstrumentLoop().
+    void LoRaRX();
+    // Post EVENT_LORA_RX. Called from the RATS_LORA_INT ISR.
+    void LoRaISR();
+    // Attach the RATS_LORA_INT ISR. It is detached while the radio mode is changed.
+    void LoRaAttachISR(void (*isr)(void));
+
 private:
     // internal serial interface objects for the MCB and ECU
     MCBComm mcbComm;
 
+    // Frame id of the last TM sent
+    uint32_t last_tm_frame = 0;
+    // The last TM that a TMAck could be pinned to, and its answer (see TMAckReceived())
+    uint32_t tm_answered_frame = 0;
+    bool tm_answered_ack = false;
+    // Called by RunZephyrRouter() for each TMAck received
+    void TMAckReceived(bool ack);
+
+    // Main loop timing, filled in by loop()
+    LoopProfiler loop_profiler;
+    // Deferred log records, see RATS_LOG()
+    RATSLog rats_log;
+    // SD card log of the RATS report and MCB TM payloads
+    RATSDataLog data_log;
+    // Log a TM payload to the SD card. Returns the sequence number, or DATALOG_NO_SEQ.
+    uint32_t DataLogAppend(DataLogType_t type, const uint8_t* data, uint16_t length);
+    // Send the next record of a RATSREPLAY request, paced by ACTION_DATALOG_REPLAY
+    void DataLogReplay();
+    // The remaining RATSREPLAY range
+    uint32_t replay_next = 0;
+    uint32_t replay_last = 0;
+    bool replay_active = false;
+    // Queue the TM that has been built in zephyrTX. Returns without waiting for the serial port.
+    void SendTM();
+    // The TX status of a TM frame returned by SendTM(), including its TMAck if it is known
+    TMTXStatus_t TMStatus(uint32_t frame);
+
     // EEPROM interface object
     RATSConfigs ratsConfigs;
 
@@ -165,6 +609,17 @@ private:
     
     void RATS_Shutdown();
 
+    // Put the MCB and LoRa radio to sleep, and scale the clock down
+    void LowPowerEnter();
+    // Restore the clock and the LoRa radio
+    void LowPowerExit();
+    bool lp_sleeping = false;
+    uint32_t lp_enter_millis = 0;
+    // Time spent in WFI since LowPowerEnter()
+    uint64_t lp_sleep_us = 0;
+    // While sleeping, from an event being posted to the main loop taking it, for each event
+    LatencyStats_t wake_latency[NUM_RATS_EVENTS];
+
     // Save a copy of inst_mode here, since it is private in StratoCore.
     // It gets set whenever one of the mode handlers is entered. 
     // It's silly inst_mode is private, since shared functions sometime want 
@@ -179,6 +634,7 @@ private:
         FL_WARMUP,
         FL_MEASURE,
         FL_REEL,
+        FL_PROFILE,
         FL_ERROR = MODE_ERROR,
         FL_SHUTDOWN = MODE_SHUTDOWN,
         FL_EXIT = MODE_EXIT
@@ -200,9 +656,56 @@ private:
     bool Flight_Reel(bool restart);
     // A sub-sub state machine to manage the warmup operations.
     bool Flight_Warmup(bool restart);
+    // A sub-sub state machine that runs the legs of ratsConfigs.profile, using Flight_Reel().
+    bool Flight_Profile(bool restart);
 
     // Telcommand handler - returns ack/nak
     bool TCHandler(Telecommand_t telecommand);
+    // TC dispatch table, lookup and admission check
+    static const TCEntry_t tc_table[];
+    TCStats_t tc_stats[NUM_RATS_TCS] = {};
+    const TCEntry_t* TCLookup(Telecommand_t telecommand);
+    bool TCAdmit(const TCEntry_t& entry);
+    // TC handlers, in tc_table order
+    bool TCDeployLength();
+    bool TCDeployVelocity();
+    bool TCDeployAcceleration();
+    bool TCRetractLength();
+    bool TCRetractVelocity();
+    bool TCRetractAcceleration();
+    bool TCFullRetract();
+    bool TCCancelMotion();
+    bool TCZeroReel();
+    bool TCTorqueLimits();
+    bool TCCurrLimits();
+    bool TCIgnoreLimits();
+    bool TCUseLimits();
+    bool TCGetMCBEEPROM();
+    bool TCGetMCBVolts();
+    bool TCControllersOn();
+    bool TCControllersOff();
+    bool TCDataProcType();
+    bool TCRealTimeMCBOn();
+    bool TCRealTimeMCBOff();
+    bool TCLoRaTXTestOn();
+    bool TCLoRaTXTestOff();
+    bool TCGetRATSEEPROM();
+    bool TCECUTemp();
+    bool TCECUPowerOn();
+    bool TCECUPowerOff();
+#ifdef RATS_EXTENDED_TCS
+    bool TCReportConfig();
+    bool TCMCBDecimate();
+    bool TCGetLoopStats();
+    bool TCWarmupConfig();
+    bool TCReelOverlap();
+    bool TCProfileLeg();
+    bool TCProfileStart();
+    bool TCReplay();
+    bool TCMotionMonitor();
+    bool TCDutyCycle();
+    bool TCLoRaAdaptive();
+#endif
 
     // *** Action processing ***
     // Action handler for scheduled actions
@@ -211,8 +714,21 @@ private:
     bool CheckAction(uint8_t action);
     // Correctly set an action flag
     void SetAction(uint8_t action);
-    // Monitor the action flags and clear old ones
+    // Monitor the action flags, count and clear old ones
     void WatchFlags();
+    // Schedule action to be set delay_ms from now, replacing any pending schedule
+    // of it, and any unchecked flag from an earlier one
+    void ScheduleAction(uint8_t action, uint32_t delay_ms);
+    // Cancel a pending scheduled action, and clear its flag if it is already set
+    void CancelAction(uint8_t action);
+    // Set the flags of due scheduled actions, highest priority first. Called on
+    // every pass through loop().
+    void RunRATSScheduler();
+    // Priority scheduler behind ScheduleAction()
+    RATSScheduler rats_scheduler;
+    // Action flags that went stale without being checked, total and per action
+    uint32_t stale_actions = 0;
+    uint16_t stale_action_counts[NUM_ACTIONS] = {0};
     // Used by StratoRATS action logic (I wonder why this logic is not in the StratoCore class?)
     ActionFlag_t action_flags[NUM_ACTIONS] = {{0}}; // initialize all flags to false
 
@@ -220,26 +736,106 @@ private:
     // Global variable to track flight_substate_map[inst_subst] during flight mode
     uint8_t flight_mode_substate = 0;
 
+    // *** Event and latency tracking ***
+    // Events posted but not yet taken by the main loop
+    volatile uint8_t pending_events = 0;
+    // micros() when the first Zephyr/MCB RX event was posted since the last take
+    volatile uint32_t zephyr_rx_micros = 0;
+    volatile uint32_t mcb_rx_micros = 0;
+    // micros() when each event (by bit position) was first posted since the last take
+    volatile uint32_t event_micros[NUM_RATS_EVENTS] = {0};
+    // Set by TCHandler(), so that RunZephyrRouter() knows that a TC was ACKed
+    bool tc_received = false;
+    // Zephyr RX to TC ACK sent
+    LatencyStats_t tc_ack_latency;
+    // MCB RX to InitMCBMotionTracking()
+    LatencyStats_t mcb_ack_latency;
+
+    // *** Serial buffer monitoring ***
+    SerialBufferStats_t zephyr_serial_stats;
+    SerialBufferStats_t mcb_serial_stats;
+    // Sample the buffer usage of the Zephyr and MCB ports
+    void SampleSerialBuffers();
+
     // *** LoRa support ***
-    // Call this during every loop to check for incoming LoRa messages.
-    void LoRaRX();
-    // The most recently received LoRa message.
-    ECULoRaMsg_t lora_msg;
+    // Read LoRa frames from the radio into lora_rx_queue, in the main loop only.
+    void LoRaRead();
+    // Detach and reattach the RATS_LORA_INT ISR around radio mode changes, so
+    // that the DIO line does not fire in the middle of the SPI1 transactions.
+    void LoRaMaskISR();
+    void LoRaUnmaskISR();
+    void (*lora_isr)(void) = nullptr;
+    // Frames are pushed by LoRaRead() and popped by LoRaRX().
+    etl::queue<LoRaFrame_t, LORA_RX_QUEUE_SIZE> lora_rx_queue;
+    // The most recently received LoRa frame.
+    LoRaFrame_t lora_frame;
+    // Frames dropped by LoRaRead() because lora_rx_queue was full.
+    uint32_t lora_rx_overflows = 0;
+    // The value of lora_rx_overflows that has been accounted for in the message count checks.
+    uint32_t lora_rx_overflows_counted = 0;
+    // Frames that were lost over the radio link (gaps in lora_msg.count not due to overflows).
+    uint32_t lora_radio_losses = 0;
     // The total number of LoRa messages received since the application started.
     uint32_t total_lora_count = 0;
-    // A temporary counter to track the number of LoRa messages received during warmup.
-    uint32_t lora_count = 0;
-    // Count incoming lora messages. If reset is set, the
-    // count is set to 0. 
-    // Return the current count.
-    // Uses the global variable lora_count.
-    uint32_t lora_count_check(bool reset=false);
     // Set to true to enable LoRa TX test mode
     bool lora_tx_test = false;
 
+    // *** LoRa link quality and adaptive rate (LoRaLink.cpp) ***
+    // Find the boot SF/BW in the link steps
+    void LoRaLinkInit();
+    // Return to the boot rate, when the ECU is powered on
+    void LoRaLinkReset();
+    // Update the link stats, called from LoRaRX() for each frame
+    void LoRaLinkFrame(const LoRaFrame_t& frame, uint32_t lost);
+    // Follow a requested rate change, fall back if it failed, and request a new one
+    void LoRaLinkService();
+    // Send a rate change, with lora_link_ecu_txp, to the ECU
+    void LoRaLinkRequest(uint8_t step_index);
+    // Set the RATS radio to a link step
+    void LoRaLinkApply(uint8_t step_index);
+    // The current SF, and bandwidth in 125 kHz units, for the RATS report header
+    uint8_t LoRaLinkSF() const;
+    uint8_t LoRaLinkBW() const;
+    LoRaLinkStats_t lora_link;
+    uint8_t lora_link_step = 0;
+    uint8_t lora_link_boot_step = 0;
+    uint8_t lora_link_request_step = 0;
+    // The ECU TX power, dBm
+    int8_t lora_link_ecu_txp = TX_POWER;
+    // Set if the boot SF/BW is not a link step
+    bool lora_link_fixed = false;
+    // A rate change was sent, waiting for the uplink that carries it
+    bool lora_link_request_pending = false;
+    // When the RATS radio is due to follow, 0 if not
+    uint32_t lora_link_switch_millis = 0;
+    // Set after the rate changed, until the handshake is complete
+    bool lora_link_verify = false;
+    // An uplink was received on the new rate / the confirmation was sent
+    bool lora_link_heard = false;
+    bool lora_link_confirm_sent = false;
+    uint32_t lora_link_rx_millis = 0;
+
     // ECU control
     void ECUControl(bool enable);
 
+    // *** ECU config queue (ECUConfig.cpp) ***
+    // Parameter changes are merged and sent to the ECU in one LoRa downlink.
+    // Queue a parameter change
+    void ECUConfigSet(ECUConfigParam_t param, float value);
+    // Send all queued and unsent parameters in one downlink. 
+    // Returns false if there was nothing to send.
+    bool ECUConfigSend();
+    // Check whether the downlink has gone out, called for each ECU LoRa message
+    void ECUConfigCheck();
+    // True when no parameters are queued or waiting to go out
+    bool ECUConfigIdle() { return !(ecu_config_pending | ecu_config_sent); }
+    float ecu_config_values[NUM_ECU_CONFIG_PARAMS] = {};
+    // Bit masks of ECUConfigParam_t; queued, and handed to the radio but not yet sent
+    uint8_t ecu_config_pending = 0;
+    uint8_t ecu_config_sent = 0;
+    // total_lora_count when the downlink was queued
+    uint32_t ecu_config_sent_count = 0;
+
     // *** Warmup state machine ***
     // LoRa message timeout counter
     uint32_t LoRaMsg_timer_start = 0;
@@ -247,6 +843,16 @@ private:
     WarmupStatus_t warmup_status = WARMUP_INPROCESS;
     // Number of warmup cycles
     uint8_t warmup_cycles = 0;
+    // Called by LoRaRX() for each ECU LoRa frame. Counts the frames that meet 
+    // the warmup thresholds, sends the ECU config and completes the warmup
+    // as soon as the frame that does it arrives.
+    void WarmupLoRaFrame(const LoRaFrame_t& frame);
+    // True if the frame carries a complete ECU report with a measurement in it
+    bool WarmupRecordReady(const LoRaFrame_t& frame);
+    // Set by Flight_Warmup() while the warmup is waiting for ECU frames
+    bool warmup_listening = false;
+    // Frames that met the warmup thresholds since warmup_listening was set
+    uint16_t warmup_good_frames = 0;
 
     // *** Reel motion variables ***
     // Set in TCHandler(), used in Flight_Reel.
@@ -256,6 +862,50 @@ private:
     // uint32_t start time of the current reel motion, in millis
     uint32_t reel_motion_start = 0;
 
+    // *** Motion health monitor (MotionHealth.cpp) ***
+    struct MotionHealth_t {
+        bool enabled;
+        bool fault;
+        uint32_t stall_ms;          // from ratsConfigs.motion_stall_secs
+        float overspeed;            // from ratsConfigs.motion_overspeed
+        uint32_t records;           // motion TM records checked
+        uint32_t last_tm_ms;
+        float stall_pos;            // reel_pos at stall_ms_start
+        uint32_t stall_ms_start;
+        float window_pos;           // reel_pos at window_ms_start
+        uint32_t window_ms_start;
+        float max_rate;             // highest windowed reel rate, revs/min
+        uint32_t faults;            // motions cancelled by the monitor
+        char msg[64];               // description of the fault
+    };
+    MotionHealth_t motion_health = {};
+    // Load the thresholds and reset the monitor, at the start of a motion
+    void MotionHealthStart();
+    // Check a decoded motion TM record against the commanded motion
+    void MotionHealthCheck();
+    // Check that motion TM is still arriving, called from Flight_Reel()
+    void MotionHealthWatchdog();
+    // Record the fault description and set ACTION_MOTION_HEALTH
+    void MotionHealthFault(const char* format, ...);
+
+    // *** MCB command queue (MCBQueue.cpp) ***
+    // Queue an MCB command with up to two float parameters. Urgent commands skip ahead
+    // of the waiting commands and the in-flight limit, and are never dropped for a full
+    // queue. Returns false if it was dropped.
+    bool MCBCommand(uint8_t msg_id, float param0 = 0.0f, float param1 = 0.0f, bool urgent = false);
+    // Send waiting commands and retry overdue ones. Called from the loop.
+    void MCBQueueService();
+    // Match an MCB ACK to its queued command
+    void MCBQueueAck(uint8_t msg_id);
+    void MCBQueueTX(MCBQueued_t& entry);
+    // Make room for an urgent command: drop the newest non-urgent command not yet sent
+    void MCBQueueEvict(uint8_t command);
+    void MCBQueueRemove(uint8_t index);
+    static const MCBCommandEntry_t mcb_cmd_table[NUM_MCB_COMMANDS];
+    MCBCommandStats_t mcb_cmd_stats[NUM_MCB_COMMANDS] = {};
+    MCBQueued_t mcb_queue[MCB_QUEUE_SIZE];
+    uint8_t mcb_queue_count = 0;
+
     // *** MCB support ***
     // Handle ASCII messages from the MCB (in MCBRouter.cpp)
     void HandleMCBASCII();
@@ -274,11 +924,59 @@ private:
     // IF WE ARE IN REAL-TIME MODE, THE TM PACKET WILL BE SENT IMMEDIATELY.
     void AddMCBTM();
     // Send a TM with a StateMessage1 message, and the aggregated MCB binary info.
-    // All of the aggregated MCB binary data are included in the TM packet.
+    // All of the aggregated MCB binary data are included in the TM packet. During
+    // a profile, StateMessage3 carries the chunk sequence number.
+    // With mcb_tm_ack_wait set, the TM is kept in MCB_TM_buffer for ResendMCBTM().
     void SendMCBTM(StateFlag_t state_flag, const char * message);
+    // Build the motion TM in the XMLWriter from the MCB TM buffer and mcb_tm_details
+    void MCBTMBuild(StateFlag_t state_flag, const char * message);
+    // Send the kept motion TM again, then release it
+    void ResendMCBTM();
+    // The motion TM no longer needs to be kept for a resend
+    void MCBTMAckDone();
+    // Send an MCB status message (voltages and so on) as a TM without binary data.
+    // The MCB TM buffer is left alone, so a motion TM being collected is not disturbed.
+    void SendMCBStatusTM(StateFlag_t state_flag, const char * message);
     bool mcb_low_power = false;
     // Set when a reel motion is initiated, cleared when the motion is complete.
     bool mcb_motion_ongoing = false;
+    // Set when an MCB motion TM is received, cleared when FL_REEL starts a motion
+    bool mcb_motion_seen = false;
+    // ratsConfigs.reel_overlap, latched when FL_REEL is entered
+    bool reel_overlapped = false;
+    // Set while Flight_Reel() waits for the final motion TM ACK. RATS report TMs
+    // are held, and the motion TM is kept in MCB_TM_buffer for a resend.
+    bool mcb_tm_ack_wait = false;
+    // The kept motion TM: its TM frame, length in MCB_TM_buffer and state message
+    uint32_t mcb_tm_frame = 0;
+    uint16_t mcb_tm_kept_length = 0;
+    StateFlag_t mcb_tm_kept_flag = FINE;
+    char mcb_tm_kept_message[64] = "";
+    // Set by Flight_Profile() for all but the last leg, so that Flight_Reel() 
+    // finishes without waiting for the motion TM ACK.
+    bool reel_skip_tm_ack = false;
+    // Motion parameter overrides for a profile leg, 0 to use the configs
+    float motion_velocity = 0.0f;
+    uint8_t motion_decimation_override = 0;
+    // The configs for the current motion
+    MotionConfig_t motion_config = {};
+    // Take the motion_config snapshot for mcb_motion
+    void MotionConfigSnapshot();
+    // ECU measurement duty cycle in FL_MEASURE (Flight_Measure.cpp)
+    void Flight_Measure(bool restart);
+    // Duty cycle turned off: power the ECU back on if it is between bursts
+    void DutyCycleStop();
+    uint32_t duty_burst_start = 0;
+    // ecu_records at the start of the burst
+    uint32_t duty_burst_records = 0;
+    // ECU records accumulated, and ECU on-time, since startup
+    uint32_t ecu_records = 0;
+    uint32_t ecu_on_millis = 0;
+    uint32_t ecu_on_total_ms = 0;
+    // Profile sequencer state
+    uint8_t profile_leg = 0;
+    // Set by CANCELMOTION to stop the profile after the current leg
+    bool profile_abort = false;
     // The maximum time allowed for a reel motion to complete.
     uint32_t max_reel_seconds = 0;
     // TODO: Will be used in the safety mode, which has been implemented yet
@@ -292,34 +990,127 @@ private:
     float reel_pos = 0.0;
     // array of error values for MCB motion fault
     uint16_t motion_fault[8] = {0};
-    // A buffer to collect MCB binary data for the MCB TM.
-    uint8_t MCB_TM_buffer[8192] = {0};
+    // Buffers shared by users that never run at the same time
+    RATSArena rats_arena;
+    // A buffer to collect MCB binary data for the MCB TM, MCB_TM_BUFFER_SIZE bytes in rats_arena.
+    // Held by ARENA_MCB_TM from InitMCBMotionTracking() until the last chunk is sent.
+    // Every user calls MCBTMAcquire() first, and leaves the buffer alone if it fails.
+    uint8_t* MCB_TM_buffer = nullptr;
+    // Acquire MCB_TM_buffer for ARENA_MCB_TM. Logs and returns false if another user holds it.
+    bool MCBTMAcquire();
     // Next available index in the MCB TM buffer.
     uint16_t MCB_TM_buffer_idx = 0;
+    // Set while a non-real-time motion profile is being collected in MCB_TM_buffer
+    bool mcb_tm_streaming = false;
+    // Sequence number of the current MCB TM chunk within the profile
+    uint16_t mcb_tm_chunk = 0;
+    // Data log sequence number of the last MCB TM
+    uint32_t mcb_tm_seq = DATALOG_NO_SEQ;
+    // StateMessage3 of the last MCB TM
+    char mcb_tm_details[32] = "";
+    // The profile start time, repeated at the start of every chunk
+    uint32_t mcb_profile_start_epoch = 0;
+    // Start a new chunk in MCB_TM_buffer
+    void MCBTMStartChunk();
+    // Reel position and rate summary for decimated MCB TM mode
+    struct ReelSummary_t {
+        uint8_t count;
+        float min_pos;
+        float max_pos;
+        float sum_pos;
+        float min_rate;
+        float max_rate;
+    };
+    ReelSummary_t reel_summary = {0};
+    // Add reel_pos and reel_rate to reel_summary
+    void MCBTMSummarize();
+    // Append the reel_summary record to MCB_TM_buffer if it has samples, and reset it
+    void MCBTMFlushSummary();
+    // Reel rate from the last two motion records (revs/min), and the state to measure it
+    float reel_rate = 0.0f;
+    float mcb_tm_prev_pos = 0.0f;
+    uint32_t mcb_tm_prev_ms = 0;
+    float mcb_tm_start_pos = 0.0f;
+    // Update reel_rate, and open a full-rate window if the reel is near a limit
+    void MCBTMCheckLimits();
+    // Keep records at full rate for the next MCB_TM_FULL_RATE_RECORDS
+    void MCBTMFullRate();
+    // Records kept at full rate up to this mcb_tm_counter value
+    uint16_t mcb_tm_full_rate_until = 0;
+    // The latest records that were decimated away, added to the TM on a fault
+    struct MCBTMHeld_t {
+        uint16_t elapsed_time;
+        uint8_t data[MOTION_TM_SIZE];
+    };
+    etl::circular_buffer<MCBTMHeld_t, MCB_TM_HELD_RECORDS> mcb_tm_held;
+    // Add the held records to MCB_TM_buffer, as far as they fit
+    void MCBTMFlushHeld();
+    // Append a motion record to MCB_TM_buffer
+    void MCBTMAddRecord(uint16_t elapsed_time, const uint8_t* data);
     // tracks the current type of motion
     MCBMotion_t mcb_motion = NO_MOTION;
 
     // *** Other TC handlers ***
     // Send a TM with MCB EEPROM contents
     void SendMCBEEPROM();
-    // Send a TM with RATS EEPROM contents
+    // Send a TM with RATS EEPROM contents, followed by the loop statistics, and reset them.
+    // RATSGETEEPROM is the flight build's way to fetch the loop statistics.
     void SendRATSEEPROM();
+    // Send a TM with the main loop timing statistics, and reset them.
+    void SendLoopStats();
+    // Add the loop statistics to the TM binary data
+    void AddLoopStatsTM();
+    // Reset the loop statistics once they have been sent
+    void ResetLoopStats();
 
     // *** RatsReports ***
     // Check if it's time for a ratsReport and send a TM if true.
     // If time_based is true, the report will be sent if the time period has elapsed.
     // If time_based is false, the report will be sent based on ACTION_RATS_REPORT.
     void ratsReportCheck(bool time_based=false);
-    // Send a TM with the ratsReport message
+    // Seal the filling report if there is no sealed report waiting, then
+    // send the oldest sealed report as a TM.
     void ratsReportTM();
-    // The RATS report header. It will be serialized and added to the TM buffer.
-    RATSReportHeader_t rats_report_header;
-    // Buffer for buliding the RATS report TM
-    RATSReportTM_t rats_report_tm;
+    // The RATS report buffers
+    RATSReportSlot_t rats_reports[RATS_REPORT_SLOTS];
+    // The slot that is accumulating ECU records
+    uint8_t rats_fill_slot = 0;
+    // ECU records lost because all report slots were sealed
+    uint32_t rats_report_drops = 0;
     // Time of last RATS report
     time_t last_rats_report = 0;
-    // Accumulate RATS reports for transmission
-    void ratsReportAccumulate(ECUReportBytes_t& ecu_report_bytes);
+    // The current batch size and period, from ratsConfigs and the link adaptation.
+    // The batch size is at most NUM_ECU_REPORTS, the capacity of a report slot.
+    uint16_t rats_batch_records = NUM_ECU_REPORTS;
+    uint32_t rats_period_secs = 300;
+    // RATS report TM ACK tracking
+    bool rats_tm_ack_pending = false;
+    uint32_t rats_tm_frame = 0;
+    uint32_t rats_tm_sent_millis = 0;
+    LatencyStats_t rats_tm_ack_latency;
+    uint32_t rats_tm_naks = 0;
+    // Data log sequence number of the last RATS report TM
+    uint32_t rats_tm_seq = DATALOG_NO_SEQ;
+    // Load the RATS report cadence from ratsConfigs
+    void ratsReportConfigure();
+    // Check for the RATS report TM ACK, and adapt the cadence if enabled
+    void ratsReportAdapt();
+    // Copy an ECU record directly into the next record slot of the filling report.
+    // The report is sealed when it is full.
+    // Returns a pointer to the stored record, or nullptr if it was dropped.
+    uint8_t* ratsReportAccumulate(const uint8_t* ecu_record, uint8_t len);
+    // Serialize the header of the filling report, mark it sealed and move on to the next slot.
+    void ratsReportSeal();
+    // Make the next slot the filling slot, applying RATS_REPORT_FULL_POLICY if it is still sealed.
+    // Returns false if there is no slot available.
+    bool ratsReportNextSlot();
+    // Clear a slot so that it can accumulate records, in the currently configured format
+    void ratsReportReset(RATSReportSlot_t& slot);
+    // Encode a record in REPORT_FORMAT_CHANGED_BYTES at dst, and update slot.prev_record.
+    // Returns the number of bytes written.
+    uint16_t ratsReportChangedBytesEncode(RATSReportSlot_t& slot, const uint8_t* ecu_record, uint8_t len, uint8_t* dst);
+    // Returns the oldest sealed report, or nullptr if there are none
+    RATSReportSlot_t* ratsReportOldestSealed();
 
 };
 #endif /* STRATORATS_H */
@@ -1,221 +1,559 @@
-#include <ArduinoJson.h>
+#include <stdarg.h>
 #include "StratoRATS.h"
 
-static JsonDocument ecu_json;
-static char ecu_json_str[ECU_LORA_DATA_BUFSIZE];
+static char msg[LOG_ARRAY_SIZE];
 
-// The telecommand handler must return ACK/NAK
-bool StratoRATS::TCHandler(Telecommand_t telecommand)
+// Format the TC summary message into msg
+static void TCMsg(const char* format, ...)
 {
-    // Set up the TC summary message
-    String msg("Unhandled TC " + String(telecommand) + " received");
-    LOG_LEVEL_t summary_level = LOG_NOMINAL;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+}
 
-    switch (telecommand) {
-    // MCB Telecommands -----------------------------------
-    case DEPLOYx:
-        msg = "TC Deploy Length";
-        if (inst_substate == FL_MEASURE) {
-            deploy_length = mcbParam.deployLen;
-            msg += ": " + String(deploy_length, 1) + " revs";
-            SetAction(ACTION_REEL_OUT);
-        } else {
-            msg = "Cannot deploy, not in FL_MEASURE";
-            summary_level = LOG_ERROR;
-        }
-        break;
-    case DEPLOYv:
-        msg = "TC Deploy Velocity: " + String(mcbParam.deployVel);
-        ratsConfigs.deploy_velocity.Write(mcbParam.deployVel);
-        break;
-    case DEPLOYa:
-        msg = "TC Deploy Acceleration: " + String(mcbParam.deployAcc);
-        if (!mcbComm.TX_Out_Acc(mcbParam.deployAcc)) {
-            msg = "Error sending deploy acc to MCB";
-        }
-        break;
-    case RETRACTx:
-        msg = "TC Retract Length";
-        if (inst_substate == FL_MEASURE) {
-            retract_length = mcbParam.retractLen;
-            SetAction(ACTION_REEL_IN);
-            msg +=  ": " + String(retract_length, 1) + " revs";
-        } else {
-            msg = "Cannot retract, not in FL_MEASURE";
-            summary_level = LOG_ERROR;
-        }
-        break;
-    case RETRACTv:
-        msg = "TC Retract Velocity: " + String(mcbParam.retractVel);
-        ratsConfigs.retract_velocity.Write(mcbParam.retractVel);
-        break;
-    case RETRACTa:
-        msg = "TC Retract Acceleration: " + String(mcbParam.retractAcc);
-        if (!mcbComm.TX_In_Acc(mcbParam.retractAcc)) {
-            msg = "Error sending retract acc to MCB";
-        }
-        break;
-    case FULLRETRACT:
-        // todo: determine implementation
-        msg = "TC Full Retract";
-        break;
-    case CANCELMOTION:
-        msg = "TC Cancel Motion";
-        mcbComm.TX_ASCII(MCB_CANCEL_MOTION); // no matter what, attempt to send (irrespective of mode)
-        SetAction(ACTION_MOTION_STOP);
-        break;
-    case ZEROREEL:
-        msg = "TC Zero Reel";
-        if (mcb_motion_ongoing) {
-            msg = "Can't zero reel, motion ongoing";
-            summary_level = LOG_ERROR;
-        } else {
-            mcbComm.TX_ASCII(MCB_ZERO_REEL);
-        }
-        break;
-    case TORQUELIMITS:
-        msg = "TC Torque Limits";
-        if (!mcbComm.TX_Torque_Limits(mcbParam.torqueLimits[0],mcbParam.torqueLimits[1])) {
-            msg = "Error sending torque limits to MCB";
-            summary_level = LOG_ERROR;
-        }
-        break;
-    case CURRLIMITS:
-        msg = "TC Current Limits";
-        if (!mcbComm.TX_Curr_Limits(mcbParam.currLimits[0],mcbParam.currLimits[1])) {
-            msg = "Error sending curr limits to MCB";
-            summary_level = LOG_ERROR;
-        }
-        break;
-    case IGNORELIMITS:
-        msg = "TC Ignore Limits";
-        mcbComm.TX_ASCII(MCB_IGNORE_LIMITS);
-        break;
-    case USELIMITS:
-        msg = "TC Use Limits";
-        mcbComm.TX_ASCII(MCB_USE_LIMITS);
-        break;
-    case GETMCBEEPROM:
-        msg = "TC get MCB EEPROM";
-        if (mcb_motion_ongoing) {
-            msg = "Motion ongoing, request MCB EEPROM later";
-            summary_level = LOG_ERROR;
-        } else {
-            // Request the MCB EEPROM. MCBRouter will handle the response
-            mcbComm.TX_ASCII(MCB_GET_EEPROM);
-        }
-        break;
-    case GETMCBVOLTS:
-        msg = "TC get MCB voltages";
-        mcbComm.TX_ASCII(MCB_GET_VOLTAGES);
-        break;
-    case CONTROLLERSON:
-        msg = "TC MCB controllers on";
-        mcbComm.TX_ASCII(MCB_CONTROLLERS_ON);
-        break;
-    case CONTROLLERSOFF:
-        msg = "TC MCB controllers off";
-        mcbComm.TX_ASCII(MCB_CONTROLLERS_OFF);
-        break;
+#define FL_OR_SB (TC_MODE(MODE_FLIGHT) | TC_MODE(MODE_STANDBY))
 
+// The TC dispatch table. The admission rules (modes, required flight substate,
+// flags) are checked by TCHandler() before the handler runs. A handler sets the
+// summary message with TCMsg() and returns false if the TC failed.
+const TCEntry_t StratoRATS::tc_table[] = {
+    // TC                   Name                  Handler                               Modes            Substate         Flags                           Log level
+    // MCB Telecommands -----------------------------------
+    {DEPLOYx,            "DEPLOYx",            &StratoRATS::TCDeployLength,        TC_ALL_MODES,    FL_MEASURE,      0,                              LOG_NOMINAL},
+    {DEPLOYv,            "DEPLOYv",            &StratoRATS::TCDeployVelocity,      TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {DEPLOYa,            "DEPLOYa",            &StratoRATS::TCDeployAcceleration,  TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RETRACTx,           "RETRACTx",           &StratoRATS::TCRetractLength,       TC_ALL_MODES,    FL_MEASURE,      0,                              LOG_NOMINAL},
+    {RETRACTv,           "RETRACTv",           &StratoRATS::TCRetractVelocity,     TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RETRACTa,           "RETRACTa",           &StratoRATS::TCRetractAcceleration, TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {FULLRETRACT,        "FULLRETRACT",        &StratoRATS::TCFullRetract,         TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {CANCELMOTION,       "CANCELMOTION",       &StratoRATS::TCCancelMotion,        TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {ZEROREEL,           "ZEROREEL",           &StratoRATS::TCZeroReel,            TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {TORQUELIMITS,       "TORQUELIMITS",       &StratoRATS::TCTorqueLimits,        TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {CURRLIMITS,         "CURRLIMITS",         &StratoRATS::TCCurrLimits,          TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {IGNORELIMITS,       "IGNORELIMITS",       &StratoRATS::TCIgnoreLimits,        TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {USELIMITS,          "USELIMITS",          &StratoRATS::TCUseLimits,           TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {GETMCBEEPROM,       "GETMCBEEPROM",       &StratoRATS::TCGetMCBEEPROM,        TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {GETMCBVOLTS,        "GETMCBVOLTS",        &StratoRATS::TCGetMCBVolts,         TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {CONTROLLERSON,      "CONTROLLERSON",      &StratoRATS::TCControllersOn,       TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {CONTROLLERSOFF,     "CONTROLLERSOFF",     &StratoRATS::TCControllersOff,      TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
     // RATS Telecommands -----------------------------------
-    case RATSDATAPROCTYPE:
-        msg = "TC set processing mode" + String(ratsParam.data_proc_method);
-        ratsConfigs.data_proc_method.Write(ratsParam.data_proc_method);
-        break;
-    case RATSREALTIMEMCBON:
-        msg = "Enabled real-time MCB mode";
-        if (mcb_motion_ongoing) {
-            msg = "Cannot start real-time MCB mode, motion ongoing";
-            summary_level = LOG_ERROR;
-        } else {
-            ratsConfigs.real_time_mcb.Write(true);
-        }
-        break;
-    case RATSREALTIMEMCBOFF:
-        msg = "Disabled real-time MCB mode";
-        if (mcb_motion_ongoing) {
-            msg = "Cannot start real-time MCB mode, motion ongoing";
-            summary_level = LOG_ERROR;
-        } else {
-            ratsConfigs.real_time_mcb.Write(false);
-        }
-        break;
-    case RATSLORATXTESTON:
-        if (my_inst_mode != MODE_STANDBY) {
-            msg = "TC Cannot start LoRa TX test, not in standby mode";
-            summary_level = LOG_ERROR;
-            break;
-        }
-        lora_tx_test = true;
-        scheduler.AddAction(ACTION_LORA_TX_TEST, 1);
-        msg = "TC LoRa TX test on";
-        break;
-    case RATSLORATXTESTOFF:
-        lora_tx_test = false;
-        msg = "TC LoRa TX test off";
-        break;
-    case RATSGETEEPROM:
-        msg = "TC get RATS EEPROM";
-        if (mcb_motion_ongoing) {
-            msg = "Motion ongoing, request RATS EEPROM later";
-            summary_level = LOG_ERROR;
-        } else {
-            SendRATSEEPROM();
+    {RATSDATAPROCTYPE,   "RATSDATAPROCTYPE",   &StratoRATS::TCDataProcType,        TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSREALTIMEMCBON,  "RATSREALTIMEMCBON",  &StratoRATS::TCRealTimeMCBOn,       TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {RATSREALTIMEMCBOFF, "RATSREALTIMEMCBOFF", &StratoRATS::TCRealTimeMCBOff,      TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {RATSLORATXTESTON,   "RATSLORATXTESTON",   &StratoRATS::TCLoRaTXTestOn,        TC_MODE(MODE_STANDBY), TC_ANY_SUBSTATE, 0,                        LOG_NOMINAL},
+    {RATSLORATXTESTOFF,  "RATSLORATXTESTOFF",  &StratoRATS::TCLoRaTXTestOff,       TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSGETEEPROM,      "RATSGETEEPROM",      &StratoRATS::TCGetRATSEEPROM,       TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {RATSECUTEMP,        "RATSECUTEMP",        &StratoRATS::TCECUTemp,             TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSECUPWRON,       "RATSECUPWRON",       &StratoRATS::TCECUPowerOn,          FL_OR_SB,        TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSECUPWROFF,      "RATSECUPWROFF",      &StratoRATS::TCECUPowerOff,         TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+#ifdef RATS_EXTENDED_TCS
+    // Extended RATS Telecommands (see NUM_RATS_EXTENDED_TCS) -----------------------------------
+    {RATSREPORTCONFIG,   "RATSREPORTCONFIG",   &StratoRATS::TCReportConfig,        TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSMCBDECIMATE,    "RATSMCBDECIMATE",    &StratoRATS::TCMCBDecimate,         TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {RATSGETLOOPSTATS,   "RATSGETLOOPSTATS",   &StratoRATS::TCGetLoopStats,        TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {RATSWARMUPCONFIG,   "RATSWARMUPCONFIG",   &StratoRATS::TCWarmupConfig,        TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSREELOVERLAP,    "RATSREELOVERLAP",    &StratoRATS::TCReelOverlap,         TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {RATSPROFILELEG,     "RATSPROFILELEG",     &StratoRATS::TCProfileLeg,          TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_PROFILE,                  LOG_NOMINAL},
+    {RATSPROFILESTART,   "RATSPROFILESTART",   &StratoRATS::TCProfileStart,        TC_ALL_MODES,    FL_MEASURE,      0,                              LOG_NOMINAL},
+    {RATSREPLAY,         "RATSREPLAY",         &StratoRATS::TCReplay,              TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSMOTIONMONITOR,  "RATSMOTIONMONITOR",  &StratoRATS::TCMotionMonitor,       TC_ALL_MODES,    TC_ANY_SUBSTATE, TC_NO_MOTION,                   LOG_NOMINAL},
+    {RATSDUTYCYCLE,      "RATSDUTYCYCLE",      &StratoRATS::TCDutyCycle,           TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+    {RATSLORAADAPTIVE,   "RATSLORAADAPTIVE",   &StratoRATS::TCLoRaAdaptive,        TC_ALL_MODES,    TC_ANY_SUBSTATE, 0,                              LOG_NOMINAL},
+#endif
+};
+
+// tc_table index + 1 for each TC id below TC_INDEX_SIZE, 0 if there is no entry
+static uint8_t tc_index[TC_INDEX_SIZE];
+static bool tc_index_built = false;
+
+const TCEntry_t* StratoRATS::TCLookup(Telecommand_t telecommand)
+{
+    static_assert(sizeof(tc_table) / sizeof(tc_table[0]) == NUM_RATS_TCS, "NUM_RATS_TCS must match tc_table");
+
+    if (!tc_index_built) {
+        for (uint8_t i = 0; i < NUM_RATS_TCS; i++) {
+            if ((uint32_t)tc_table[i].tc < TC_INDEX_SIZE) {
+                tc_index[tc_table[i].tc] = i + 1;
+            }
         }
-        break;
-    case RATSECUTEMP:
-        msg = "TC set ECU temp: " + String(ratsParam.ecu_tempC);
-        // Save the ECU temp to EEPROM
-        ratsConfigs.ecu_tempC.Write(ratsParam.ecu_tempC);
-        if (my_inst_mode == MODE_FLIGHT || my_inst_mode == MODE_STANDBY) {
-            ecu_json["tempC"] = ratsConfigs.ecu_tempC.Read();
-            serializeJson(ecu_json, ecu_json_str);
-            // Don't forget that the message will not be sent until we receive a message from the ECU.
-            // So it will not work to try to send two messages back-to-back.
-            // Also keep in mind that the ECU might not even be powered up right now.
-            ecu_lora_tx((uint8_t*)ecu_json_str, strlen(ecu_json_str));
+        tc_index_built = true;
+    }
+
+    if ((uint32_t)telecommand < TC_INDEX_SIZE) {
+        return tc_index[telecommand] ? &tc_table[tc_index[telecommand] - 1] : nullptr;
+    }
+
+    // TC ids outside the index are searched for
+    for (uint8_t i = 0; i < NUM_RATS_TCS; i++) {
+        if (tc_table[i].tc == telecommand) {
+            return &tc_table[i];
         }
-        break;
-    case RATSECUPWRON:
-        msg = "TC ECU power on";
-        if (my_inst_mode == MODE_FLIGHT || my_inst_mode == MODE_STANDBY) {
-            ECUControl(true);
+    }
+    return nullptr;
+}
+
+bool StratoRATS::TCAdmit(const TCEntry_t& entry)
+{
+    if (!(entry.modes & TC_MODE(my_inst_mode))) {
+        TCMsg("TC %s rejected, not allowed in mode %u", entry.name, (unsigned)my_inst_mode);
+        return false;
+    }
+    if (entry.substate != TC_ANY_SUBSTATE && (my_inst_mode != MODE_FLIGHT || inst_substate != entry.substate)) {
+        TCMsg("TC %s rejected, requires flight substate %u", entry.name, (unsigned)entry.substate);
+        return false;
+    }
+    if ((entry.flags & TC_NO_MOTION) && mcb_motion_ongoing) {
+        TCMsg("TC %s rejected, motion ongoing", entry.name);
+        return false;
+    }
+    if ((entry.flags & TC_NO_PROFILE) && my_inst_mode == MODE_FLIGHT && inst_substate == FL_PROFILE) {
+        TCMsg("TC %s rejected, profile running", entry.name);
+        return false;
+    }
+    return true;
+}
+
+// The telecommand handler must return ACK/NAK
+bool StratoRATS::TCHandler(Telecommand_t telecommand)
+{
+    tc_received = true;
+
+    LOG_LEVEL_t summary_level = LOG_ERROR;
+    const TCEntry_t* entry = TCLookup(telecommand);
+
+    if (!entry) {
+        TCMsg("Unknown TC %d received", (int)telecommand);
+    } else {
+        TCStats_t& stats = tc_stats[entry - tc_table];
+        if (!TCAdmit(*entry)) {
+            stats.rejected++;
         } else {
-            msg = "Cannot power on ECU, not in FLIGHT or STANDBY mode";
-            summary_level = LOG_ERROR;
+            uint32_t start = micros();
+            TCMsg("TC %s", entry->name);
+            if ((this->*(entry->handler))()) {
+                summary_level = entry->level;
+            }
+            uint32_t elapsed = micros() - start;
+            stats.count++;
+            stats.total_us += elapsed;
+            if (elapsed > stats.max_us) {
+                stats.max_us = elapsed;
+            }
         }
-        break;
-    case RATSECUPWROFF:
-        msg = "TC ECU power off";
-        // Turn off the ECU
-        ECUControl(false);
-        break;
-    default:
-        summary_level = LOG_ERROR;
-        msg = "Unknown TC " + String(telecommand) + " received";
-        break;
     }
 
     // Send TC summary to the StratoCore log and as a TM
     switch (summary_level) {
         case LOG_DEBUG:
-            log_debug(msg.c_str());
-            ZephyrLogFine(msg.c_str());
+            log_debug(msg);
+            ZephyrLogFine(msg);
             break;
         case LOG_NOMINAL:
-            log_nominal(msg.c_str());
-            ZephyrLogFine(msg.c_str());
+            log_nominal(msg);
+            ZephyrLogFine(msg);
             break;
         case LOG_ERROR:
-            log_error(msg.c_str());
-            ZephyrLogWarn(msg.c_str());
+            log_error(msg);
+            ZephyrLogWarn(msg);
             break;
         default:
-            log_error(msg.c_str());
-            ZephyrLogWarn(msg.c_str());
+            log_error(msg);
+            ZephyrLogWarn(msg);
     }
 
     return true;
 }
 
+// MCB Telecommands -----------------------------------
+bool StratoRATS::TCDeployLength()
+{
+    deploy_length = mcbParam.deployLen;
+    TCMsg("TC Deploy Length: %.1f revs", deploy_length);
+    SetAction(ACTION_REEL_OUT);
+    return true;
+}
+
+bool StratoRATS::TCDeployVelocity()
+{
+    TCMsg("TC Deploy Velocity: %.2f", mcbParam.deployVel);
+    ratsConfigs.deploy_velocity.Write(mcbParam.deployVel);
+    return true;
+}
+
+bool StratoRATS::TCDeployAcceleration()
+{
+    TCMsg("TC Deploy Acceleration: %.2f", mcbParam.deployAcc);
+    if (!MCBCommand(MCB_OUT_ACC, mcbParam.deployAcc)) {
+        TCMsg("Unable to queue deploy acc for MCB");
+        return false;
+    }
+    return true;
+}
+
+bool StratoRATS::TCRetractLength()
+{
+    retract_length = mcbParam.retractLen;
+    SetAction(ACTION_REEL_IN);
+    TCMsg("TC Retract Length: %.1f revs", retract_length);
+    return true;
+}
+
+bool StratoRATS::TCRetractVelocity()
+{
+    TCMsg("TC Retract Velocity: %.2f", mcbParam.retractVel);
+    ratsConfigs.retract_velocity.Write(mcbParam.retractVel);
+    return true;
+}
+
+bool StratoRATS::TCRetractAcceleration()
+{
+    TCMsg("TC Retract Acceleration: %.2f", mcbParam.retractAcc);
+    if (!MCBCommand(MCB_IN_ACC, mcbParam.retractAcc)) {
+        TCMsg("Unable to queue retract acc for MCB");
+        return false;
+    }
+    return true;
+}
+
+bool StratoRATS::TCFullRetract()
+{
+    // todo: determine implementation
+    TCMsg("TC Full Retract");
+    return true;
+}
+
+bool StratoRATS::TCCancelMotion()
+{
+    TCMsg("TC Cancel Motion");
+    // no matter what, attempt to send (irrespective of mode)
+    bool sent = MCBCommand(MCB_CANCEL_MOTION, 0.0f, 0.0f, true);
+    SetAction(ACTION_MOTION_STOP);
+    // A running profile stops after the current leg
+    profile_abort = (my_inst_mode == MODE_FLIGHT && inst_substate == FL_PROFILE);
+    if (!sent) {
+        TCMsg("Unable to send cancel motion to MCB");
+    }
+    return sent;
+}
+
+bool StratoRATS::TCZeroReel()
+{
+    TCMsg("TC Zero Reel");
+    return MCBCommand(MCB_ZERO_REEL);
+}
+
+bool StratoRATS::TCTorqueLimits()
+{
+    TCMsg("TC Torque Limits");
+    if (!MCBCommand(MCB_TORQUE_LIMITS, mcbParam.torqueLimits[0], mcbParam.torqueLimits[1])) {
+        TCMsg("Unable to queue torque limits for MCB");
+        return false;
+    }
+    return true;
+}
+
+bool StratoRATS::TCCurrLimits()
+{
+    TCMsg("TC Current Limits");
+    if (!MCBCommand(MCB_CURR_LIMITS, mcbParam.currLimits[0], mcbParam.currLimits[1])) {
+        TCMsg("Unable to queue curr limits for MCB");
+        return false;
+    }
+    return true;
+}
+
+bool StratoRATS::TCIgnoreLimits()
+{
+    TCMsg("TC Ignore Limits");
+    return MCBCommand(MCB_IGNORE_LIMITS);
+}
+
+bool StratoRATS::TCUseLimits()
+{
+    TCMsg("TC Use Limits");
+    return MCBCommand(MCB_USE_LIMITS);
+}
+
+bool StratoRATS::TCGetMCBEEPROM()
+{
+    // Request the MCB EEPROM. MCBRouter will handle the response
+    TCMsg("TC get MCB EEPROM");
+    return MCBCommand(MCB_GET_EEPROM);
+}
+
+bool StratoRATS::TCGetMCBVolts()
+{
+    TCMsg("TC get MCB voltages");
+    return MCBCommand(MCB_GET_VOLTAGES);
+}
+
+bool StratoRATS::TCControllersOn()
+{
+    TCMsg("TC MCB controllers on");
+    return MCBCommand(MCB_CONTROLLERS_ON);
+}
+
+bool StratoRATS::TCControllersOff()
+{
+    TCMsg("TC MCB controllers off");
+    return MCBCommand(MCB_CONTROLLERS_OFF);
+}
+
+// RATS Telecommands -----------------------------------
+bool StratoRATS::TCDataProcType()
+{
+    // Selects the RATSReportFormat_t, starting with the next RATS report
+    TCMsg("TC set processing mode %u", (unsigned)ratsParam.data_proc_method);
+    ratsConfigs.data_proc_method.Write(ratsParam.data_proc_method);
+    return true;
+}
+
+bool StratoRATS::TCRealTimeMCBOn()
+{
+    TCMsg("Enabled real-time MCB mode");
+    ratsConfigs.real_time_mcb.Write(true);
+    return true;
+}
+
+bool StratoRATS::TCRealTimeMCBOff()
+{
+    TCMsg("Disabled real-time MCB mode");
+    ratsConfigs.real_time_mcb.Write(false);
+    return true;
+}
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCMCBDecimate()
+{
+    TCMsg("TC set MCB TM decimation: %u", (unsigned)ratsParam.mcb_decimation);
+    ratsConfigs.mcb_decimation.Write(ratsParam.mcb_decimation);
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCReportConfig()
+{
+    TCMsg("TC RATS report config: %u records, %u s, adaptive %u",
+        (unsigned)ratsParam.report_records, (unsigned)ratsParam.report_period, (unsigned)ratsParam.report_adaptive);
+    if (0 == ratsParam.report_records || 0 == ratsParam.report_period) {
+        TCMsg("RATS report records and period must be non-zero");
+        return false;
+    }
+    ratsConfigs.report_records.Write(ratsParam.report_records);
+    ratsConfigs.report_period.Write(ratsParam.report_period);
+    ratsConfigs.report_adaptive.Write(ratsParam.report_adaptive);
+    ratsReportConfigure();
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCWarmupConfig()
+{
+    TCMsg("TC RATS warmup config: %u msgs, rssi >= %d dBm, snr >= %.1f dB",
+        (unsigned)ratsParam.warmup_msgs, (int)ratsParam.warmup_min_rssi, ratsParam.warmup_min_snr);
+    if (0 == ratsParam.warmup_msgs) {
+        TCMsg("RATS warmup message count must be non-zero");
+        return false;
+    }
+    ratsConfigs.warmup_msgs.Write(ratsParam.warmup_msgs);
+    ratsConfigs.warmup_min_rssi.Write(ratsParam.warmup_min_rssi);
+    ratsConfigs.warmup_min_snr.Write(ratsParam.warmup_min_snr);
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCReelOverlap()
+{
+    TCMsg("TC RATS reel overlap: %u", (unsigned)ratsParam.reel_overlap);
+    ratsConfigs.reel_overlap.Write(ratsParam.reel_overlap);
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCMotionMonitor()
+{
+    TCMsg("TC RATS motion monitor: %s, stall %u s, overspeed x%.2f",
+        ratsParam.motion_monitor ? "on" : "off", (unsigned)ratsParam.motion_stall_secs, ratsParam.motion_overspeed);
+    if (ratsParam.motion_monitor && (0 == ratsParam.motion_stall_secs || ratsParam.motion_overspeed <= 1.0f)) {
+        TCMsg("RATS motion monitor stall time must be non-zero and overspeed above 1");
+        return false;
+    }
+    ratsConfigs.motion_monitor.Write(ratsParam.motion_monitor);
+    ratsConfigs.motion_stall_secs.Write(ratsParam.motion_stall_secs);
+    ratsConfigs.motion_overspeed.Write(ratsParam.motion_overspeed);
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCDutyCycle()
+{
+    TCMsg("TC RATS duty cycle: %s, on %u s, off %u s, %u records",
+        ratsParam.duty_cycle ? "on" : "off", (unsigned)ratsParam.duty_on_secs,
+        (unsigned)ratsParam.duty_off_secs, (unsigned)ratsParam.duty_records);
+    if (ratsParam.duty_cycle && (0 == ratsParam.duty_on_secs || 0 == ratsParam.duty_off_secs)) {
+        TCMsg("RATS duty cycle on and off times must be non-zero");
+        return false;
+    }
+    ratsConfigs.duty_cycle.Write(ratsParam.duty_cycle);
+    ratsConfigs.duty_on_secs.Write(ratsParam.duty_on_secs);
+    ratsConfigs.duty_off_secs.Write(ratsParam.duty_off_secs);
+    ratsConfigs.duty_records.Write(ratsParam.duty_records);
+    // Turning the duty cycle off always brings the ECU back on. Otherwise start
+    // the new cycle with a fresh burst, the ECU is still on only in MEASURE_ON.
+    if (!ratsParam.duty_cycle) {
+        DutyCycleStop();
+    } else if (my_inst_mode == MODE_FLIGHT && inst_substate == FL_MEASURE && digitalRead(ECU_PWR_EN)) {
+        Flight_Measure(true);
+    }
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCLoRaAdaptive()
+{
+    TCMsg("TC RATS LoRa adaptive rate: %s", ratsParam.lora_adaptive ? "on" : "off");
+    ratsConfigs.lora_adaptive.Write(ratsParam.lora_adaptive);
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCProfileLeg()
+{
+    TCMsg("TC RATS profile leg %u: %s %.1f revs, %.1f revs/min, dwell %u s, ECU %s, decimation %u",
+        (unsigned)ratsParam.profile_leg, ratsParam.profile_direction ? "in" : "out",
+        ratsParam.profile_length, ratsParam.profile_velocity, (unsigned)ratsParam.profile_dwell,
+        ratsParam.profile_ecu_on ? "on" : "off", (unsigned)ratsParam.profile_decimation);
+    if (ratsParam.profile_leg >= RATS_PROFILE_MAX_LEGS || ratsParam.profile_length <= 0) {
+        TCMsg("Invalid RATS profile leg");
+        return false;
+    }
+    ProfileTable_t table = ratsConfigs.profile.Read();
+    // Uploading leg 0 starts a new program
+    if (0 == ratsParam.profile_leg) {
+        table = ProfileTable_t{};
+    }
+    ProfileLeg_t& leg = table.legs[ratsParam.profile_leg];
+    leg.direction = ratsParam.profile_direction ? PROFILE_LEG_IN : PROFILE_LEG_OUT;
+    leg.length = ratsParam.profile_length;
+    leg.velocity = ratsParam.profile_velocity;
+    leg.dwell_secs = ratsParam.profile_dwell;
+    leg.flags = ratsParam.profile_ecu_on ? PROFILE_LEG_ECU_ON : 0;
+    leg.decimation = ratsParam.profile_decimation;
+    // The highest leg uploaded ends the program; RATSPROFILESTART checks that none are missing
+    table.leg_mask |= (1 << ratsParam.profile_leg);
+    if (ratsParam.profile_leg + 1 > table.num_legs) {
+        table.num_legs = ratsParam.profile_leg + 1;
+    }
+    ratsConfigs.profile.Write(table);
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCProfileStart()
+{
+    TCMsg("TC RATS profile start");
+    const ProfileTable_t table = ratsConfigs.profile.Read();
+    if (0 == table.num_legs) {
+        TCMsg("Cannot start RATS profile, no legs uploaded");
+        return false;
+    }
+    if (table.leg_mask != PROFILE_ALL_LEGS(table.num_legs)) {
+        TCMsg("Cannot start RATS profile, legs missing (mask 0x%02x of %u legs)",
+            (unsigned)table.leg_mask, (unsigned)table.num_legs);
+        return false;
+    }
+    SetAction(ACTION_PROFILE_START);
+    return true;
+}
+#endif
+
+bool StratoRATS::TCLoRaTXTestOn()
+{
+    lora_tx_test = true;
+    ScheduleAction(ACTION_LORA_TX_TEST, 1000);
+    TCMsg("TC LoRa TX test on");
+    return true;
+}
+
+bool StratoRATS::TCLoRaTXTestOff()
+{
+    lora_tx_test = false;
+    TCMsg("TC LoRa TX test off");
+    return true;
+}
+
+bool StratoRATS::TCGetRATSEEPROM()
+{
+    TCMsg("TC get RATS EEPROM");
+    SendRATSEEPROM();
+    return true;
+}
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCGetLoopStats()
+{
+    TCMsg("TC get RATS loop stats");
+    SendLoopStats();
+    return true;
+}
+#endif
+
+#ifdef RATS_EXTENDED_TCS
+bool StratoRATS::TCReplay()
+{
+    TCMsg("TC RATS replay seq %lu to %lu", ratsParam.replay_first, ratsParam.replay_last);
+    if (!data_log.Ready()) {
+        TCMsg("RATS replay rejected, SD data log unavailable");
+        return false;
+    }
+    if (ratsParam.replay_first > ratsParam.replay_last || ratsParam.replay_last >= data_log.NextSeq()
+        || ratsParam.replay_last - ratsParam.replay_first >= DATALOG_REPLAY_MAX) {
+        TCMsg("Invalid RATS replay range %lu to %lu, %lu records logged",
+            ratsParam.replay_first, ratsParam.replay_last, data_log.NextSeq());
+        return false;
+    }
+    // A new request replaces one in progress
+    replay_next = ratsParam.replay_first;
+    replay_last = ratsParam.replay_last;
+    replay_active = true;
+    ScheduleAction(ACTION_DATALOG_REPLAY, 0);
+    return true;
+}
+#endif
+
+bool StratoRATS::TCECUTemp()
+{
+    TCMsg("TC set ECU temp: %d", (int)ratsParam.ecu_tempC);
+    // Save the ECU temp to EEPROM
+    ratsConfigs.ecu_tempC.Write(ratsParam.ecu_tempC);
+    // Merged with any other unsent changes into one downlink
+    ECUConfigSet(ECU_CONFIG_TEMPC, ratsConfigs.ecu_tempC.Read());
+    if (my_inst_mode == MODE_FLIGHT || my_inst_mode == MODE_STANDBY) {
+        ECUConfigSend();
+    }
+    return true;
+}
+
+bool StratoRATS::TCECUPowerOn()
+{
+    TCMsg("TC ECU power on");
+    ECUControl(true);
+    return true;
+}
+
+bool StratoRATS::TCECUPowerOff()
+{
+    TCMsg("TC ECU power off");
+    // Turn off the ECU
+    ECUControl(false);
+    return true;
+}
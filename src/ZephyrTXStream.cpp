@@ -0,0 +1,62 @@
+/*
+ *  ZephyrTXStream.cpp
+ *
+ *  Zephyr TX byte and frame tracking, see ZephyrTXStream.h
+ */
+
+#include "ZephyrTXStream.h"
+
+ZephyrTXStream::ZephyrTXStream(Stream* port)
+    : port(port)
+{
+}
+
+size_t ZephyrTXStream::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+// A single availableForWrite() per write, most TM bytes come one at a time
+
+size_t ZephyrTXStream::write(const uint8_t* data, size_t len)
+{
+    if (sink) {
+        discarded += len;
+        bytes_written += len;
+        return len;
+    }
+
+    uint32_t room = port->availableForWrite();
+    if (room > tx_capacity) {
+        tx_capacity = room;
+    }
+    // The port waits for room itself, this only counts it
+    if (room < len) {
+        blocked_count++;
+    }
+    size_t n = port->write(data, len);
+    bytes_written += n;
+
+    // The level the write took the buffer to, full if it had to wait
+    uint32_t used = (room < n) ? tx_capacity : tx_capacity - room + n;
+    if (used > high_water) {
+        high_water = used;
+    }
+
+    return n;
+}
+
+uint32_t ZephyrTXStream::Used()
+{
+    uint32_t room = port->availableForWrite();
+    if (room > tx_capacity) {
+        tx_capacity = room;
+    }
+    return tx_capacity - room;
+}
+
+TMTXStatus_t ZephyrTXStream::Status(uint32_t frame)
+{
+    uint32_t bytes_sent = bytes_written - Used();
+    return ((int32_t)(bytes_sent - frame) >= 0) ? TM_TX_SENT : TM_TX_QUEUED;
+}
@@ -0,0 +1,74 @@
+/*
+ *  ZephyrTXStream.h
+ *
+ *  A Stream that sits between StratoCore and the Zephyr serial port. Reads and
+ *  writes are passed straight through; the TX buffer that setup() adds to the
+ *  port (ZEPHYR_SERIAL_BUFFER_SIZE) holds a complete TM, so zephyrTX.TM()
+ *  returns as soon as the TM has been buffered, and the UART interrupt sends it.
+ *
+ *  This does not make Zephyr output non-blocking. When back-to-back TMs fill
+ *  the TX buffer (an MCB chunk, a RATS report and a resend), port->write()
+ *  still waits for room and stalls the loop; blocked_count counts those writes.
+ *
+ *  The bytes written are counted, and each complete TM is marked as a frame,
+ *  so that the frame status can be queried later from the port's TX buffer
+ *  level.
+ */
+
+#ifndef ZEPHYRTXSTREAM_H
+#define ZEPHYRTXSTREAM_H
+
+#include <Arduino.h>
+
+enum TMTXStatus_t : uint8_t {
+    TM_TX_QUEUED,   // Still (partially) in the serial TX buffer
+    TM_TX_SENT,     // Completely sent by the serial port
+    TM_TX_ACKED,    // ACKed by the Zephyr (see StratoRATS::TMStatus())
+    TM_TX_NAKED     // NAKed by the Zephyr
+};
+
+class ZephyrTXStream : public Stream {
+public:
+    ZephyrTXStream(Stream* port);
+
+    // Stream reads, passed through to the port
+    int available() override { return port->available(); }
+    int read() override { return port->read(); }
+    int peek() override { return port->peek(); }
+
+    // Writes, passed through to the port and counted
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int availableForWrite() override { return port->availableForWrite(); }
+    // Does not wait: the port sends its TX buffer on its own, and waiting
+    // here would stall the control loop for a whole TM.
+    void flush() override { }
+
+    // Mark the end of a complete frame (TM). Returns the frame id.
+    uint32_t MarkFrame() const { return bytes_written; }
+    // Query the status of a frame
+    TMTXStatus_t Status(uint32_t frame);
+
+    // Discard all writes (used by the benchmarks)
+    void SetSink(bool sink) { this->sink = sink; }
+    // Bytes discarded while in sink mode
+    uint32_t discarded = 0;
+
+    // Bytes waiting in the port's TX buffer
+    uint32_t Used();
+    // Maximum bytes used in the port's TX buffer, as seen by write()
+    uint32_t high_water = 0;
+    // Number of writes that had to wait for room in the TX buffer (they still wait)
+    uint32_t blocked_count = 0;
+
+private:
+    Stream* port;
+    bool sink = false;
+    // The largest availableForWrite() seen, the size of the empty TX buffer
+    uint32_t tx_capacity = 0;
+
+    // Running count of the bytes written to the port
+    uint32_t bytes_written = 0;
+};
+
+#endif /* ZEPHYRTXSTREAM_H */